@@ -0,0 +1,639 @@
+#ifndef LANDSCAPE_AUTOTUNE_HPP
+#define LANDSCAPE_AUTOTUNE_HPP
+
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <utility>
+#include <iostream>
+#include <algorithm>
+#include <boost/geometry.hpp>
+#include <boost/geometry/index/rtree.hpp>
+#include "gridindex.hpp"
+#include "indexquery.hpp"
+#include "policies.hpp"
+
+namespace landscape
+{
+/*
+ * Choosing the spatial index at run time.
+ *
+ * Which index is fastest depends on N, the mating radius or k, and on how
+ * clustered the diploids are (see rtree_bench.cc), and the last two change
+ * as a simulation runs.  adaptive_index holds one of several indexes, and
+ * index_autotuner times each of them on the current diploids every K
+ * generations, and switches to the one predicted to be cheapest per
+ * generation, if the saving over the next K generations pays for the switch.
+ *
+ * All of the indexes return the same values for a query, and the rules sort
+ * possible mates by birth order (see wfrules.hpp), so which index is used
+ * never changes the output.  The autotuner has its own random numbers,
+ * so it does not change the simulation's either.
+ */
+enum class index_backend { quadratic16, quadratic64, rstar16, linear16, grid };
+
+//insert = add offspring to the index as they are born, bulk = collect
+//them, and pack the index when it is first queried.  Packing is faster
+//than inserting, and gives a better rtree, but the rtree then only
+//exists once all of the offspring are born.
+enum class index_build { insert, bulk };
+
+struct index_config
+{
+    index_backend backend;
+    index_build build;
+    double cell_size; //of the grid
+    index_config(const index_backend backend_ = index_backend::quadratic16,
+                 const index_build build_ = index_build::insert,
+                 const double cell_size_ = 0.05) :
+        backend(backend_),build(build_),cell_size(cell_size_)
+    {
+    }
+    bool operator==(const index_config & other) const
+    {
+        return backend == other.backend && build == other.build &&
+               (backend != index_backend::grid || cell_size == other.cell_size);
+    }
+    bool operator!=(const index_config & other) const
+    {
+        return !(*this == other);
+    }
+};
+
+inline std::string index_config_name(const index_config & c)
+{
+    static const char * backends[] = {"quadratic16","quadratic64","rstar16","linear16","grid"};
+    std::string rv(backends[int(c.backend)]);
+    if(c.backend == index_backend::grid) rv += "(" + std::to_string(c.cell_size) + ")";
+    return rv + (c.build == index_build::bulk ? "/bulk" : "/insert");
+}
+
+//Sets c from names such as "quadratic16" and "bulk".  Returns false if one is not known.
+inline bool parse_index_config(const std::string & backend, const std::string & build,
+                               const double cell_size, index_config & c)
+{
+    if(backend == "quadratic16") c.backend = index_backend::quadratic16;
+    else if(backend == "quadratic64") c.backend = index_backend::quadratic64;
+    else if(backend == "rstar16") c.backend = index_backend::rstar16;
+    else if(backend == "linear16") c.backend = index_backend::linear16;
+    else if(backend == "grid") c.backend = index_backend::grid;
+    else return false;
+    if(build == "insert") c.build = index_build::insert;
+    else if(build == "bulk") c.build = index_build::bulk;
+    else return false;
+    if(!(cell_size > 0.)) return false;
+    c.cell_size = cell_size;
+    return true;
+}
+
+/*
+ * A spatial index whose kind is chosen at run time, with the API
+ * of an rtree that WFLandscapeRules uses, plus switch_to.
+ * The rtrees use allocator_t, e.g. counting_allocator, and the grid does not.
+ *
+ * Queries on a const adaptive_index may be made by several threads at once
+ * (see spatialstats.hpp), except for query_nearest on the grid (see gridindex.hpp).
+ */
+template<typename value_t,typename allocator_t = std::allocator<value_t>>
+class adaptive_index
+{
+    template<typename params>
+    using rtree_t = boost::geometry::index::rtree<value_t,params,boost::geometry::index::indexable<value_t>,
+          boost::geometry::index::equal_to<value_t>,allocator_t>;
+    index_config config;
+    //mutable, as bulk builds are done by the first query
+    mutable rtree_t<boost::geometry::index::quadratic<16>> quadratic16;
+    mutable rtree_t<boost::geometry::index::quadratic<64>> quadratic64;
+    mutable rtree_t<boost::geometry::index::rstar<16>> rstar16;
+    mutable rtree_t<boost::geometry::index::linear<16>> linear16;
+    mutable grid_index<value_t> grid;
+    //For bulk builds, everything in the index.  The index is packed
+    //from these when it is queried, if packed is false.
+    std::vector<value_t> values;
+    mutable std::atomic<bool> packed;
+    mutable std::mutex pack_mutex;
+
+    //An unused grid has one cell
+    double grid_cell_size() const
+    {
+        return config.backend == index_backend::grid ? config.cell_size : 1.;
+    }
+
+    //The backends are mutable, so f gets a non-const reference
+    template<typename visitor>
+    void visit(visitor & f) const
+    {
+        switch(config.backend)
+        {
+        case index_backend::quadratic16:
+            f(quadratic16);
+            break;
+        case index_backend::quadratic64:
+            f(quadratic64);
+            break;
+        case index_backend::rstar16:
+            f(rstar16);
+            break;
+        case index_backend::linear16:
+            f(linear16);
+            break;
+        case index_backend::grid:
+            f(grid);
+            break;
+        }
+    }
+
+    struct rebuilder
+    {
+        const std::vector<value_t> & v;
+        template<typename index_t>
+        void operator()(index_t & index) const
+        {
+            rebuild_index(index,v.begin(),v.end());
+        }
+    };
+
+    struct inserter
+    {
+        const value_t & v;
+        template<typename index_t>
+        void operator()(index_t & index) const
+        {
+            index.insert(v);
+        }
+    };
+
+    //Pack the index, once, if that has not been done
+    void pack() const
+    {
+        if(packed.load(std::memory_order_acquire)) return;
+        std::lock_guard<std::mutex> lock(pack_mutex);
+        if(packed.load(std::memory_order_relaxed)) return;
+        rebuilder f{values};
+        visit(f);
+        packed.store(true,std::memory_order_release);
+    }
+
+    void reset_backends()
+    {
+        quadratic16.clear();
+        quadratic64.clear();
+        rstar16.clear();
+        linear16.clear();
+        grid = grid_index<value_t>(grid_cell_size());
+        values.clear();
+        packed.store(true,std::memory_order_relaxed);
+    }
+public:
+    using value_type = value_t;
+
+    explicit adaptive_index(const index_config & c = index_config()) :
+        config(c),quadratic16(),quadratic64(),rstar16(),linear16(),grid(grid_cell_size()),
+        values(),packed(true),pack_mutex()
+    {
+    }
+
+    template<typename iterator>
+    adaptive_index(iterator first, iterator last, const index_config & c = index_config()) : adaptive_index(c)
+    {
+        switch_to(c,first,last);
+    }
+
+    adaptive_index(const adaptive_index & other) :
+        config(other.config),quadratic16(other.quadratic16),quadratic64(other.quadratic64),
+        rstar16(other.rstar16),linear16(other.linear16),grid(other.grid),values(other.values),
+        packed(other.packed.load()),pack_mutex()
+    {
+    }
+
+    //The moved-from index keeps its config, and is empty
+    adaptive_index(adaptive_index && other) :
+        config(other.config),quadratic16(std::move(other.quadratic16)),quadratic64(std::move(other.quadratic64)),
+        rstar16(std::move(other.rstar16)),linear16(std::move(other.linear16)),grid(std::move(other.grid)),
+        values(std::move(other.values)),packed(other.packed.load()),pack_mutex()
+    {
+        other.reset_backends();
+    }
+
+    adaptive_index & operator=(const adaptive_index & other)
+    {
+        if(this == &other) return *this;
+        adaptive_index temp(other);
+        return *this = std::move(temp);
+    }
+
+    //The moved-from index keeps its config.  If both have the same config,
+    //the two swap contents, so that the moved-from index can re-use its
+    //memory after a clear(), which is what WFLandscapeRules does each generation.
+    adaptive_index & operator=(adaptive_index && other)
+    {
+        if(this == &other) return *this;
+        if(config == other.config)
+        {
+            std::swap(quadratic16,other.quadratic16);
+            std::swap(quadratic64,other.quadratic64);
+            std::swap(rstar16,other.rstar16);
+            std::swap(linear16,other.linear16);
+            std::swap(grid,other.grid);
+            values.swap(other.values);
+            const bool p = packed.load();
+            packed.store(other.packed.load());
+            other.packed.store(p);
+            return *this;
+        }
+        config = other.config;
+        quadratic16 = std::move(other.quadratic16);
+        quadratic64 = std::move(other.quadratic64);
+        rstar16 = std::move(other.rstar16);
+        linear16 = std::move(other.linear16);
+        grid = std::move(other.grid);
+        values = std::move(other.values);
+        packed.store(other.packed.load());
+        other.reset_backends();
+        return *this;
+    }
+
+    const index_config & settings() const
+    {
+        return config;
+    }
+
+    //Use c from now on, with the contents [first,last).  Always bulk loads.
+    template<typename iterator>
+    void switch_to(const index_config & c, iterator first, iterator last)
+    {
+        config = c;
+        reset_backends();
+        values.assign(first,last);
+        packed.store(false,std::memory_order_relaxed);
+        pack();
+        if(config.build == index_build::insert) values.clear();
+    }
+
+    void insert(const value_t & v)
+    {
+        if(config.build == index_build::bulk)
+        {
+            values.push_back(v);
+            packed.store(false,std::memory_order_relaxed);
+            return;
+        }
+        inserter f{v};
+        visit(f);
+    }
+
+    void clear()
+    {
+        switch(config.backend)
+        {
+        case index_backend::quadratic16:
+            quadratic16.clear();
+            break;
+        case index_backend::quadratic64:
+            quadratic64.clear();
+            break;
+        case index_backend::rstar16:
+            rstar16.clear();
+            break;
+        case index_backend::linear16:
+            linear16.clear();
+            break;
+        case index_backend::grid:
+            grid.clear();
+            break;
+        }
+        values.clear();
+        packed.store(true,std::memory_order_relaxed);
+    }
+
+    std::size_t size() const
+    {
+        if(config.build == index_build::bulk) return values.size();
+        std::size_t n = 0;
+        switch(config.backend)
+        {
+        case index_backend::quadratic16:
+            n = quadratic16.size();
+            break;
+        case index_backend::quadratic64:
+            n = quadratic64.size();
+            break;
+        case index_backend::rstar16:
+            n = rstar16.size();
+            break;
+        case index_backend::linear16:
+            n = linear16.size();
+            break;
+        case index_backend::grid:
+            n = grid.size();
+            break;
+        }
+        return n;
+    }
+
+    bool empty() const
+    {
+        return size() == 0;
+    }
+
+    //Apply f to the index that is in use, once it is packed
+    template<typename visitor>
+    void query(visitor & f) const
+    {
+        pack();
+        visit(f);
+    }
+};
+
+namespace detail
+{
+template<typename point_t,typename predicate,typename output_iterator>
+struct box_query
+{
+    const point_t & lo, & hi;
+    const predicate & pred;
+    output_iterator out;
+    template<typename index_t>
+    void operator()(const index_t & index)
+    {
+        query_box(index,lo,hi,pred,out);
+    }
+};
+
+template<typename point_t,typename output_iterator>
+struct nearest_query
+{
+    const point_t & p;
+    std::size_t k;
+    output_iterator out;
+    template<typename index_t>
+    void operator()(const index_t & index)
+    {
+        query_nearest(index,p,k,out);
+    }
+};
+
+template<typename point_t,typename output_iterator>
+struct nearest_within_query
+{
+    const point_t & p;
+    std::size_t k;
+    double dmax;
+    output_iterator out;
+    template<typename index_t>
+    void operator()(const index_t & index)
+    {
+        query_nearest(index,p,k,dmax,out);
+    }
+};
+
+struct anything
+{
+    template<typename value_t>
+    bool operator()(const value_t &) const
+    {
+        return true;
+    }
+};
+}
+
+template<typename value_t,typename allocator_t,typename point_t,typename predicate,typename output_iterator>
+inline void query_box(const adaptive_index<value_t,allocator_t> & index, const point_t & lo, const point_t & hi,
+                      const predicate & pred, output_iterator out)
+{
+    detail::box_query<point_t,predicate,output_iterator> f{lo,hi,pred,out};
+    index.query(f);
+}
+
+template<typename value_t,typename allocator_t,typename point_t,typename output_iterator>
+inline void query_box(const adaptive_index<value_t,allocator_t> & index, const point_t & lo, const point_t & hi,
+                      output_iterator out)
+{
+    const detail::anything pred = detail::anything();
+    detail::box_query<point_t,detail::anything,output_iterator> f{lo,hi,pred,out};
+    index.query(f);
+}
+
+template<typename value_t,typename allocator_t,typename point_t,typename output_iterator>
+inline void query_nearest(const adaptive_index<value_t,allocator_t> & index, const point_t & p,
+                          const std::size_t k, output_iterator out)
+{
+    detail::nearest_query<point_t,output_iterator> f{p,k,out};
+    index.query(f);
+}
+
+template<typename value_t,typename allocator_t,typename point_t,typename output_iterator>
+inline void query_nearest(const adaptive_index<value_t,allocator_t> & index, const point_t & p,
+                          const std::size_t k, const double dmax, output_iterator out)
+{
+    detail::nearest_within_query<point_t,output_iterator> f{p,k,dmax,out};
+    index.query(f);
+}
+
+//Keeps the config
+template<typename value_t,typename allocator_t,typename iterator>
+inline void rebuild_index(adaptive_index<value_t,allocator_t> & index, iterator first, iterator last)
+{
+    index.switch_to(index.settings(),first,last);
+}
+
+/*
+ * Every "every" generations, index_autotuner times, on the diploids
+ * of the new generation:
+ *
+ * 1. Building each kind of index, by inserts and by a bulk load.
+ * 2. nqueries of the queries that the mating mode makes (a radius
+ *    query, or the k+1 nearest), centred on random diploids.
+ *
+ * The predicted cost of a generation is the time to build the index, plus N
+ * queries for the radius and knn modes, as pick2 makes one query per
+ * offspring.  Deme and rejection mating do not query the index (except for
+ * rejection's rare fallbacks), so only the build counts for those.
+ *
+ * The index is switched to the cheapest, if that is at least margin
+ * cheaper than the one in use, and the time saved over the next "every"
+ * generations is more than the time to switch (a bulk load of the new index),
+ * at two checks in a row.
+ * The time spent tuning is in "seconds", and is not counted against
+ * the switch, as it is spent whether or not there is a switch.
+ */
+class index_autotuner
+{
+    unsigned every;
+    mating_mode mode;
+    double radius;
+    unsigned k;
+    unsigned nqueries;
+    double margin;
+    std::uint64_t state; //xorshift64*, so that the simulation's rng is not used
+    //The index that was best at the last check, if it was worth switching to
+    index_config proposed;
+    bool has_proposal;
+
+    std::uint64_t next()
+    {
+        state ^= state >> 12;
+        state ^= state << 25;
+        state ^= state >> 27;
+        return state * 2685821657736338717ull;
+    }
+
+    static double since(const std::chrono::steady_clock::time_point & start)
+    {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    struct timing
+    {
+        index_config config;
+        double build,query,cost;
+    };
+
+    //Grid cells of about the size of a query, but no more cells than diploids
+    double grid_cell_size(const std::size_t N) const
+    {
+        const double n = double(std::max(std::size_t(1),N));
+        const double query_size = (mode == mating_mode::knn) ? std::sqrt(double(k+1)/n) : radius;
+        return std::max(query_size,1./std::sqrt(n));
+    }
+public:
+    //# checks, # switches, time spent checking, and the mean
+    //# of neighbours in a query at the last check
+    unsigned nchecks,nswitches;
+    double seconds,neighbours;
+    //If true, switches are reported on stderr
+    bool verbose;
+
+    index_autotuner(const unsigned every_, const mating_mode mode_, const double radius_, const unsigned k_,
+                    const unsigned nqueries_ = 256, const double margin_ = 0.1) :
+        every(every_),mode(mode_),radius(radius_),k(k_),nqueries(std::max(1u,nqueries_)),margin(margin_),
+        state(0x9e3779b97f4a7c15ull),proposed(),has_proposal(false),
+        nchecks(0),nswitches(0),seconds(0.),neighbours(0.),verbose(true)
+    {
+    }
+
+    bool active() const
+    {
+        return every > 0;
+    }
+
+    //Call after each generation with the new diploids, and the index
+    //of them, i.e. the rules' offspring_rtree.  Returns true if the index was switched.
+    template<typename dipcont_t,typename value_t,typename allocator_t>
+    bool operator()(const unsigned generation, const dipcont_t & diploids,
+                    adaptive_index<value_t,allocator_t> & index)
+    {
+        using index_t = adaptive_index<value_t,allocator_t>;
+        using point_t = typename dipcont_t::value_type::point;
+        namespace bg = boost::geometry;
+        if(!every || generation % every || diploids.empty()) return false;
+        const auto tuning_start = std::chrono::steady_clock::now();
+        ++nchecks;
+
+        std::vector<value_t> values;
+        values.reserve(diploids.size());
+        for(const auto & d : diploids) values.push_back(d.v);
+        std::vector<point_t> centres;
+        for(unsigned q = 0 ; q < nqueries ; ++q) centres.push_back(values[std::size_t(next() % values.size())].first);
+
+        const bool queries = (mode == mating_mode::radius || mode == mating_mode::knn);
+        const double r = radius;
+        std::vector<value_t> found;
+        std::size_t nfound = 0;
+        auto time_queries = [&](const index_t & trial) {
+            nfound = 0;
+            const auto start = std::chrono::steady_clock::now();
+            for(const auto & c : centres)
+            {
+                found.clear();
+                if(mode == mating_mode::knn) query_nearest(trial,c,k+1,std::back_inserter(found));
+                else
+                {
+                    const double x = bg::get<0>(c), y = bg::get<1>(c);
+                    query_box(trial,point_t(x-r,y-r),point_t(x+r,y+r),[x,y,r](const value_t & v) {
+                        return std::sqrt(std::pow(x-bg::get<0>(v.first),2.0)+std::pow(y-bg::get<1>(v.first),2.0)) <= r;
+                    },
+                    std::back_inserter(found));
+                }
+                nfound += found.size();
+            }
+            return since(start)/double(centres.size());
+        };
+
+        std::vector<index_config> candidates;
+        const index_backend backends[] = {index_backend::quadratic16,index_backend::quadratic64,index_backend::rstar16,
+                                          index_backend::linear16,index_backend::grid
+                                         };
+        for(const auto b : backends)
+        {
+            for(const auto build : {index_build::insert,index_build::bulk})
+            {
+                candidates.emplace_back(b,build,grid_cell_size(values.size()));
+            }
+        }
+        const index_config current = index.settings();
+        if(std::find(candidates.begin(),candidates.end(),current) == candidates.end()) candidates.push_back(current);
+
+        std::vector<timing> timings;
+        double switch_cost = 0.;
+        for(const auto & c : candidates)
+        {
+            timing t{c,0.,0.,0.};
+            {
+                index_t trial(c);
+                auto start = std::chrono::steady_clock::now();
+                for(const auto & v : values) trial.insert(v);
+                //The first query does any bulk build
+                found.clear();
+                query_box(trial,values[0].first,values[0].first,std::back_inserter(found));
+                t.build = since(start);
+                if(queries) t.query = time_queries(trial);
+            }
+            t.cost = t.build + (queries ? double(values.size())*t.query : 0.);
+            if(queries) neighbours = double(nfound)/double(centres.size());
+            timings.push_back(t);
+        }
+        auto best = std::min_element(timings.begin(),timings.end(),[](const timing & a, const timing & b) {
+            return a.cost < b.cost;
+        });
+        auto cur = std::find_if(timings.begin(),timings.end(),[&current](const timing & t) {
+            return t.config == current;
+        });
+        //Switching is a bulk load of the best backend
+        for(const auto & t : timings)
+        {
+            if(t.config.backend == best->config.backend && t.config.build == index_build::bulk) switch_cost = t.build;
+        }
+        //Timings of small indexes are noisy, so the same index
+        //has to be worth switching to at two checks in a row
+        bool switched = false;
+        const bool worth_it = best->config != current && best->cost < (1.-margin)*cur->cost &&
+                              (cur->cost - best->cost)*double(every) > switch_cost;
+        const bool confirmed = worth_it && has_proposal && proposed == best->config;
+        has_proposal = worth_it;
+        proposed = best->config;
+        if(confirmed)
+        {
+            if(verbose)
+            {
+                std::cerr << "autotune: generation " << generation << ", index " << index_config_name(current)
+                          << " -> " << index_config_name(best->config) << ", predicted seconds per generation "
+                          << cur->cost << " -> " << best->cost << ", neighbours per query " << neighbours << '\n';
+            }
+            index.switch_to(best->config,values.begin(),values.end());
+            ++nswitches;
+            switched = true;
+            has_proposal = false;
+        }
+        seconds += since(tuning_start);
+        return switched;
+    }
+};
+}
+#endif
@@ -0,0 +1,85 @@
+/*
+ * Print the replicates in an output file of wflandscape_batch
+ * as "tidy" text, in the format 0 output of wflandscape plus
+ * columns for the row of the parameter table, the replicate
+ * and its seed.
+ */
+#include "batchio.hpp"
+#include <cstdlib>
+#include <iostream>
+
+int main(int argc, char ** argv)
+{
+    if(argc<2)
+    {
+        std::cerr << "Usage:\n"
+                  << argv[0] << " batchfile [row [replicate]]\n"
+                  << "\n"
+                  << "Prints all replicates, those from one row of the parameter\n"
+                  << "table, or one replicate.  With -i as the batchfile's name,\n"
+                  << "prints the index instead.\n";
+        exit(0);
+    }
+    bool index_only = std::string(argv[1]) == "-i";
+    int argn = index_only ? 2 : 1;
+    if(argn >= argc)
+    {
+        std::cerr << "Error: no batch file given\n";
+        exit(1);
+    }
+    const std::string filename(argv[argn++]);
+    const long row = (argn < argc) ? atol(argv[argn++]) : -1;
+    const long rep = (argn < argc) ? atol(argv[argn++]) : -1;
+    try
+    {
+        landscape::batch_reader reader(filename);
+        if(index_only)
+        {
+            std::cout << "row rep seed offset bytes\n";
+            for(const auto & e : reader.index)
+            {
+                std::cout << e.row << ' ' << e.replicate << ' ' << e.seed << ' '
+                          << e.offset << ' ' << e.size << '\n';
+            }
+            return 0;
+        }
+        std::vector<char> record;
+        std::cout << "row rep seed dip x y chrom pos s\n";
+        for(const auto & e : reader.index)
+        {
+            if((row >= 0 && long(e.row) != row) || (rep >= 0 && long(e.replicate) != rep)) continue;
+            reader.read(e,record);
+            std::size_t o = 0;
+            using landscape::get;
+            const auto N = get<std::uint32_t>(record,o);
+            const auto nfixed = get<std::uint32_t>(record,o);
+            //skip fixations
+            o += nfixed*(2*sizeof(double)+sizeof(std::uint32_t));
+            for(std::uint32_t i = 0 ; i < N ; ++i)
+            {
+                const auto x = get<double>(record,o), y = get<double>(record,o);
+                for(unsigned chrom = 0 ; chrom < 2 ; ++chrom)
+                {
+                    const auto n = get<std::uint32_t>(record,o);
+                    if(!n)
+                    {
+                        std::cout << e.row << ' ' << e.replicate << ' ' << e.seed << ' '
+                                  << i << ' ' << x << ' ' << y << ' ' << chrom << " NA NA\n";
+                    }
+                    for(std::uint32_t j = 0 ; j < n ; ++j)
+                    {
+                        const auto pos = get<double>(record,o), s = get<double>(record,o);
+                        std::cout << e.row << ' ' << e.replicate << ' ' << e.seed << ' '
+                                  << i << ' ' << x << ' ' << y << ' ' << chrom << ' '
+                                  << pos << ' ' << s << '\n';
+                    }
+                }
+            }
+        }
+    }
+    catch(std::exception & e)
+    {
+        std::cerr << "Error: " << e.what() << '\n';
+        exit(1);
+    }
+}
@@ -0,0 +1,236 @@
+#ifndef LANDSCAPE_BATCHIO_HPP
+#define LANDSCAPE_BATCHIO_HPP
+
+#include <vector>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <stdexcept>
+#include <algorithm>
+
+namespace landscape
+{
+/*
+ * Indexed binary output of many replicates, written by wflandscape_batch
+ * and read by batchdump.
+ *
+ * The file is:
+ * 1. The 8 byte magic "LSBATCH2", then the uint32 0x01020304.
+ * 2. One record per replicate, in the order they finished.
+ * 3. The index: one entry per replicate, sorted by (row, replicate).
+ * 4. A trailer: the offset of the index and the # entries (uint64 each),
+ *    and the 8 byte magic "LSBATIDX".
+ *
+ * A record holds the same information as wflandscape's format 0 output,
+ * plus the fixations:
+ *
+ * uint32 N, uint32 # fixations,
+ * # fixations x (double pos, double s, uint32 fixation time),
+ * N x (double x, double y,
+ *      2 x (uint32 # selected mutations, that many x (double pos, double s))).
+ *
+ * Diploids are in birth order.  Numbers are in the byte order of the machine
+ * that wrote the file.  The reader checks that the word after the magic reads
+ * back as 0x01020304, and refuses files written with another byte order.
+ */
+struct batch_index_entry
+{
+    std::uint64_t offset,size;
+    std::uint32_t row,replicate,seed;
+};
+
+namespace detail
+{
+const char batch_magic[] = "LSBATCH2";
+const std::uint32_t batch_byte_order = 0x01020304;
+const char batch_index_magic[] = "LSBATIDX";
+const std::size_t batch_index_entry_size = 2*sizeof(std::uint64_t) + 3*sizeof(std::uint32_t);
+}
+
+//Append a value's bytes to a buffer
+template<typename T>
+inline void put(std::vector<char> & buffer, const T & t)
+{
+    const char * p = reinterpret_cast<const char *>(&t);
+    buffer.insert(buffer.end(),p,p+sizeof(T));
+}
+
+//Read a value from a buffer at offset o, and advance o
+template<typename T>
+inline T get(const std::vector<char> & buffer, std::size_t & o)
+{
+    if(o + sizeof(T) > buffer.size()) throw std::runtime_error("batch record is truncated");
+    T t;
+    std::memcpy(&t,buffer.data()+o,sizeof(T));
+    o += sizeof(T);
+    return t;
+}
+
+//Encode pop as a record.  The buffer is cleared first, keeping its capacity.
+//If the diploids are not stored in birth order, storage_index gives where each one is.
+template<typename poptype>
+void encode_replicate(std::vector<char> & buffer, const poptype & pop,
+                      const std::vector<std::size_t> & storage_index)
+{
+    buffer.clear();
+    put(buffer,std::uint32_t(pop.diploids.size()));
+    put(buffer,std::uint32_t(pop.fixations.size()));
+    for(std::size_t i = 0 ; i < pop.fixations.size() ; ++i)
+    {
+        put(buffer,double(pop.fixations[i].pos));
+        put(buffer,double(pop.fixations[i].s));
+        put(buffer,std::uint32_t(pop.fixation_times[i]));
+    }
+    for(std::size_t b = 0 ; b < pop.diploids.size() ; ++b)
+    {
+        const auto & dip = pop.diploids[storage_index.empty() ? b : storage_index[b]];
+        put(buffer,double(dip.v.first.template get<0>()));
+        put(buffer,double(dip.v.first.template get<1>()));
+        for(const auto g : {dip.first,dip.second})
+        {
+            put(buffer,std::uint32_t(pop.gametes[g].smutations.size()));
+            for(const auto & m : pop.gametes[g].smutations)
+            {
+                put(buffer,double(pop.mutations[m].pos));
+                put(buffer,double(pop.mutations[m].s));
+            }
+        }
+    }
+}
+
+/*
+ * Writes records to the file as they come in.  Not thread-safe:
+ * callers serialize calls to write().
+ */
+class batch_writer
+{
+    std::FILE * f;
+    std::uint64_t offset;
+    std::vector<batch_index_entry> index;
+public:
+    explicit batch_writer(const std::string & filename) : f(std::fopen(filename.c_str(),"wb")),offset(0),index()
+    {
+        if(f == nullptr) throw std::runtime_error("could not open " + filename + " for writing");
+        std::fwrite(detail::batch_magic,1,8,f);
+        std::fwrite(&detail::batch_byte_order,sizeof(std::uint32_t),1,f);
+        offset = 8 + sizeof(std::uint32_t);
+    }
+
+    batch_writer(const batch_writer &) = delete;
+    batch_writer & operator=(const batch_writer &) = delete;
+
+    ~batch_writer()
+    {
+        if(f != nullptr) std::fclose(f);
+    }
+
+    void write(const std::uint32_t row, const std::uint32_t replicate, const std::uint32_t seed,
+               const std::vector<char> & record)
+    {
+        if(std::fwrite(record.data(),1,record.size(),f) != record.size())
+        {
+            throw std::runtime_error("error writing batch output");
+        }
+        index.push_back(batch_index_entry{offset,record.size(),row,replicate,seed});
+        offset += record.size();
+    }
+
+    //Write the index and trailer, and close the file
+    void close()
+    {
+        std::sort(index.begin(),index.end(),[](const batch_index_entry & a, const batch_index_entry & b) {
+            return a.row < b.row || (a.row == b.row && a.replicate < b.replicate);
+        });
+        std::vector<char> buffer;
+        for(const auto & e : index)
+        {
+            put(buffer,e.offset);
+            put(buffer,e.size);
+            put(buffer,e.row);
+            put(buffer,e.replicate);
+            put(buffer,e.seed);
+        }
+        put(buffer,offset);
+        put(buffer,std::uint64_t(index.size()));
+        buffer.insert(buffer.end(),detail::batch_index_magic,detail::batch_index_magic+8);
+        bool ok = std::fwrite(buffer.data(),1,buffer.size(),f) == buffer.size();
+        ok = (std::fclose(f) == 0) && ok;
+        f = nullptr;
+        if(!ok) throw std::runtime_error("error writing batch output");
+    }
+};
+
+//Random access to the records of a batch file
+class batch_reader
+{
+    std::FILE * f;
+public:
+    std::vector<batch_index_entry> index;
+
+    explicit batch_reader(const std::string & filename) : f(std::fopen(filename.c_str(),"rb")),index()
+    {
+        if(f == nullptr) throw std::runtime_error("could not open " + filename);
+        char magic[8];
+        std::uint32_t byte_order;
+        if(std::fread(magic,1,8,f) != 8 || std::memcmp(magic,detail::batch_magic,8)
+                || std::fread(&byte_order,sizeof(std::uint32_t),1,f) != 1)
+        {
+            std::fclose(f);
+            throw std::runtime_error(filename + " is not a batch file");
+        }
+        if(byte_order != detail::batch_byte_order)
+        {
+            std::fclose(f);
+            throw std::runtime_error(filename + " was written on a machine with a different byte order");
+        }
+        std::vector<char> trailer(24);
+        if(std::fseek(f,-24,SEEK_END) || std::fread(trailer.data(),1,24,f) != 24
+                || std::memcmp(trailer.data()+16,detail::batch_index_magic,8))
+        {
+            std::fclose(f);
+            throw std::runtime_error(filename + " has no index.  Was it written completely?");
+        }
+        std::size_t o = 0;
+        auto index_offset = get<std::uint64_t>(trailer,o);
+        auto n = get<std::uint64_t>(trailer,o);
+        std::vector<char> buffer(n*detail::batch_index_entry_size);
+        std::fseek(f,long(index_offset),SEEK_SET);
+        if(std::fread(buffer.data(),1,buffer.size(),f) != buffer.size())
+        {
+            std::fclose(f);
+            throw std::runtime_error(filename + ": could not read the index");
+        }
+        o = 0;
+        for(std::uint64_t i = 0 ; i < n ; ++i)
+        {
+            batch_index_entry e;
+            e.offset = get<std::uint64_t>(buffer,o);
+            e.size = get<std::uint64_t>(buffer,o);
+            e.row = get<std::uint32_t>(buffer,o);
+            e.replicate = get<std::uint32_t>(buffer,o);
+            e.seed = get<std::uint32_t>(buffer,o);
+            index.push_back(e);
+        }
+    }
+
+    batch_reader(const batch_reader &) = delete;
+    batch_reader & operator=(const batch_reader &) = delete;
+
+    ~batch_reader()
+    {
+        std::fclose(f);
+    }
+
+    void read(const batch_index_entry & e, std::vector<char> & record)
+    {
+        record.resize(e.size);
+        std::fseek(f,long(e.offset),SEEK_SET);
+        if(std::fread(record.data(),1,record.size(),f) != record.size())
+        {
+            throw std::runtime_error("could not read batch record");
+        }
+    }
+};
+}
+#endif
@@ -0,0 +1,182 @@
+/*
+ * Compares the approximate deme mating mode (demes.hpp) to exact
+ * mate choice within the mating radius.
+ *
+ * Replicates are run in pairs with the same seed, once with each
+ * mode, and spatial summaries (spatialstats.hpp) are averaged over
+ * replicates.  For each statistic, the output has the mean and
+ * standard error under each mode, and z = the difference in means
+ * divided by its standard error.  If the approximation is good,
+ * the |z| should look like draws from a standard normal.
+ */
+#include "simulation.hpp"
+#include "spatialstats.hpp"
+#include "options.hpp"
+#include <cassert> //fwdpp has this missing in one of its headers...
+#include <cstdlib>
+#include <chrono>
+#include <iostream>
+
+//Running mean and variance of each element of a vector-valued statistic
+struct accumulator
+{
+    std::vector<double> sum,sumsq;
+    std::vector<unsigned> n;
+    void add(const std::vector<double> & x)
+    {
+        if(sum.size() < x.size())
+        {
+            sum.resize(x.size(),0.);
+            sumsq.resize(x.size(),0.);
+            n.resize(x.size(),0);
+        }
+        for(std::size_t i = 0 ; i < x.size() ; ++i)
+        {
+            if(std::isnan(x[i])) continue;
+            sum[i] += x[i];
+            sumsq[i] += x[i]*x[i];
+            n[i]++;
+        }
+    }
+    double mean(std::size_t i) const
+    {
+        return n[i] ? sum[i]/double(n[i]) : std::numeric_limits<double>::quiet_NaN();
+    }
+    double se(std::size_t i) const
+    {
+        if(n[i] < 2) return std::numeric_limits<double>::quiet_NaN();
+        double m = mean(i);
+        return std::sqrt(std::max(0.,(sumsq[i]/double(n[i]) - m*m)*double(n[i])/double(n[i]-1))/double(n[i]));
+    }
+};
+
+//The statistics that are compared
+struct summaries
+{
+    accumulator ibd,pi,het,load,fst;
+    void add(const landscape::spatial_stats & s)
+    {
+        ibd.add(s.ibd_meandiff);
+        pi.add(s.cell_pi);
+        het.add(s.cell_het);
+        //Selected mutations differ between runs, so compare the
+        //sum of their frequencies in each cell, i.e. the mean # of
+        //selected mutations per gamete.
+        std::vector<double> l(s.cell_n.size(),0.);
+        const std::size_t K = s.selected_keys.size();
+        for(std::size_t c = 0 ; c < l.size() ; ++c)
+        {
+            if(!s.cell_n[c]) l[c] = std::numeric_limits<double>::quiet_NaN();
+            else for(std::size_t j = 0 ; j < K ; ++j) l[c] += s.selected_freqs[c*K+j];
+        }
+        load.add(l);
+        fst.add(std::vector<double>(1,s.Fst));
+    }
+};
+
+int main(int argc, char ** argv)
+{
+    if(argc<12)
+    {
+        std::cerr << "Incorrect number of arguments.\n"
+                  << "Usage:\n"
+                  << argv[0] << ' '
+                  << "N "
+                  << "theta "
+                  << "rho "
+                  << "s "
+                  << "h "
+                  << "mutrate_to_selected "
+                  << "radius "
+                  << "dispersal "
+                  << "seed "
+                  << "nreps "
+                  << "generations\n"
+                  << "\n"
+                  << "Output lines are: stat index exact exact_se deme deme_se z,\n"
+                  << "then: summary stat mean|z| max|z|, and: time exact_seconds deme_seconds speedup\n"
+                  << "\n"
+                  << "Optional arguments, given as name=value after generations:\n"
+                  << "grid = G means compare surfaces on a GxG grid (default 4)\n"
+                  << "ibd_bins, ibd_dmax, threads: as for wflandscape\n";
+        exit(0);
+    }
+    int argn = 1;
+    landscape::landscape_params p;
+    p.N = atoi(argv[argn++]);
+    p.theta = atof(argv[argn++]);
+    p.rho = atof(argv[argn++]);
+    p.s = atof(argv[argn++]);
+    p.h = atof(argv[argn++]);
+    p.mu = atof(argv[argn++]);
+    p.radius = atof(argv[argn++]);
+    p.dispersal = atof(argv[argn++]);
+    const unsigned seed = atoi(argv[argn++]);
+    const unsigned nreps = atoi(argv[argn++]);
+    const unsigned generations = atoi(argv[argn++]);
+
+    landscape::options opts(argc,argv,argn);
+    landscape::spatial_stats_params stats_params;
+    stats_params.grid = opts.get("grid",4u);
+    stats_params.ibd_bins = opts.get("ibd_bins",stats_params.ibd_bins);
+    stats_params.ibd_dmax = opts.get("ibd_dmax",stats_params.ibd_dmax);
+    stats_params.nthreads = opts.get("threads",stats_params.nthreads);
+    opts.check();
+
+    summaries exact,approx;
+    double exact_seconds = 0., approx_seconds = 0.;
+    landscape::landscape_simulation<> sim;
+    for(unsigned rep = 0 ; rep < nreps ; ++rep)
+    {
+        const auto rseed = landscape::replicate_seed(seed,rep);
+        for(const auto mode : {landscape::mating_mode::radius,landscape::mating_mode::deme})
+        {
+            p.mating = mode;
+            sim.reset(p,rseed);
+            auto start = std::chrono::steady_clock::now();
+            sim.step(generations);
+            std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+            auto stats = landscape::spatial_summaries(sim.population(),sim.index(),stats_params);
+            if(mode == landscape::mating_mode::radius)
+            {
+                exact_seconds += elapsed.count();
+                exact.add(stats);
+            }
+            else
+            {
+                approx_seconds += elapsed.count();
+                approx.add(stats);
+            }
+        }
+    }
+
+    auto compare = [](const char * name, const accumulator & a, const accumulator & b) {
+        double sumz = 0., maxz = 0.;
+        unsigned nz = 0;
+        for(std::size_t i = 0 ; i < std::min(a.sum.size(),b.sum.size()) ; ++i)
+        {
+            double z = (b.mean(i) - a.mean(i))/std::sqrt(a.se(i)*a.se(i) + b.se(i)*b.se(i));
+            std::cout << name << ' ' << i << ' ' << a.mean(i) << ' ' << a.se(i) << ' '
+                      << b.mean(i) << ' ' << b.se(i) << ' ' << z << '\n';
+            if(std::isfinite(z))
+            {
+                sumz += std::fabs(z);
+                maxz = std::max(maxz,std::fabs(z));
+                ++nz;
+            }
+        }
+        return std::make_pair(nz ? sumz/double(nz) : std::numeric_limits<double>::quiet_NaN(),maxz);
+    };
+    const std::pair<const char *,std::pair<double,double>> results[] = {
+        {"ibd",compare("ibd",exact.ibd,approx.ibd)},
+        {"pi",compare("pi",exact.pi,approx.pi)},
+        {"het",compare("het",exact.het,approx.het)},
+        {"load",compare("load",exact.load,approx.load)},
+        {"fst",compare("fst",exact.fst,approx.fst)}
+    };
+    for(const auto & r : results)
+    {
+        std::cout << "summary " << r.first << ' ' << r.second.first << ' ' << r.second.second << '\n';
+    }
+    std::cout << "time " << exact_seconds << ' ' << approx_seconds << ' ' << exact_seconds/approx_seconds << '\n';
+}
@@ -0,0 +1,215 @@
+#ifndef LANDSCAPE_DEMES_HPP
+#define LANDSCAPE_DEMES_HPP
+
+#include <vector>
+#include <cmath>
+#include <cstdint>
+#include <algorithm>
+#include <gsl/gsl_rng.h>
+#include <boost/geometry/core/access.hpp>
+
+namespace landscape
+{
+/*
+ * Approximate mate choice on a grid of "demes".
+ *
+ * The landscape is cut into square cells about the size of
+ * the mating radius r, and each generation every parent is
+ * binned into its cell.  The exact rule picks parent 2 from everyone
+ * within r of parent 1, proportional to fitness.  Here, we instead
+ * pretend parent 1 is at the centre of its cell, and everyone is spread
+ * uniformly over their cell.  The chance of picking someone from a
+ * neighbouring cell is then proportional to the total fitness of that
+ * cell times the fraction of its area inside the mating disk.  With a
+ * cell size of at least r, only the 3x3 block of cells around
+ * parent 1 overlaps the disk.
+ *
+ * Per generation, building the grid costs O(N + # cells).  Per pick, parent 2
+ * costs O(1): choose one of 9 cells, then someone in it via a Walker
+ * alias table over the cell's fitnesses.  No spatial queries are needed.
+ *
+ * This is an approximation.  It gets worse as r shrinks relative to the
+ * scale over which allele frequencies change.  See deme_validation.cc.
+ */
+class deme_grid
+{
+    unsigned G;      //# cells per side
+    double h;        //cell size
+    double radius;   //radius that the overlaps were computed for
+    //overlap[(dy+1)*3 + dx+1] is the fraction of cell (ix+dx,iy+dy) within
+    //the mating radius of the centre of cell (ix,iy)
+    double overlap[9];
+    //cell of each diploid, and the diploids sorted by cell
+    std::vector<unsigned> cell_of;
+    std::vector<std::size_t> cell_start, members;
+    //Walker alias tables for each cell, in the same order as members
+    std::vector<double> prob;
+    std::vector<std::size_t> alias;
+    std::vector<double> cell_w;
+    //cumulative weights of the 9 cells around each cell
+    std::vector<double> neighbour_cumw;
+    std::vector<std::size_t> next,small,large;
+
+    inline unsigned coord(double x) const
+    {
+        auto c = (x > 0.) ? unsigned(x/h) : 0u;
+        return (c >= G) ? G-1 : c;
+    }
+
+    //Fraction of the unit cell offset by (dx,dy) cells from the centre cell
+    //that lies within distance r (in units of cells) of its centre.
+    //Midpoint rule on a 64x64 grid, which is plenty for an approximation.
+    static double cell_overlap(int dx, int dy, double r)
+    {
+        const int m = 64;
+        unsigned inside = 0;
+        for(int i = 0 ; i < m ; ++i)
+        {
+            double x = double(dx) - 0.5 + (double(i) + 0.5)/double(m);
+            for(int j = 0 ; j < m ; ++j)
+            {
+                double y = double(dy) - 0.5 + (double(j) + 0.5)/double(m);
+                if(x*x + y*y <= r*r) ++inside;
+            }
+        }
+        return double(inside)/double(m*m);
+    }
+
+    void set_radius(double r)
+    {
+        radius = r;
+        //Cells at least as large as r, and at most 4096^2 of them
+        G = unsigned(std::max(1.,std::min(4096.,std::floor(1.0/r))));
+        h = 1.0/double(G);
+        for(int dy = -1 ; dy <= 1 ; ++dy)
+        {
+            for(int dx = -1 ; dx <= 1 ; ++dx)
+            {
+                overlap[(dy+1)*3 + dx+1] = cell_overlap(dx,dy,r/h);
+            }
+        }
+    }
+
+    //Walker's alias method for weights w[first,last) of members
+    void build_alias(const std::size_t first, const std::size_t last, const std::vector<double> & w)
+    {
+        const std::size_t n = last - first;
+        if(!n) return;
+        double total = 0.;
+        for(std::size_t i = first ; i < last ; ++i) total += w[members[i]];
+        small.clear();
+        large.clear();
+        for(std::size_t i = first ; i < last ; ++i)
+        {
+            prob[i] = (total > 0.) ? w[members[i]]*double(n)/total : 1.;
+            alias[i] = i;
+            if(prob[i] < 1.) small.push_back(i);
+            else large.push_back(i);
+        }
+        while(!small.empty() && !large.empty())
+        {
+            auto s = small.back(), l = large.back();
+            small.pop_back();
+            alias[s] = l;
+            prob[l] -= 1. - prob[s];
+            if(prob[l] < 1.)
+            {
+                large.pop_back();
+                small.push_back(l);
+            }
+        }
+        //Left-overs are 1 up to rounding
+        for(auto i : small) prob[i] = 1.;
+        for(auto i : large) prob[i] = 1.;
+    }
+public:
+    deme_grid() : G(0),h(1.),radius(-1.),cell_of(),cell_start(),members(),prob(),alias(),
+        cell_w(),neighbour_cumw(),next(),small(),large()
+    {
+        std::fill(overlap,overlap+9,0.);
+    }
+
+    /* Bin the diploids and build the tables.  fitnesses are in the order
+     * of diploids.  If not empty, storage_index[b] is where the b-th diploid
+     * born is stored, and diploids within a cell are kept in birth order,
+     * so that results do not depend on where diploids are stored.
+     */
+    template<typename dipcont_t>
+    void build(const dipcont_t & diploids, const std::vector<double> & fitnesses,
+               const std::vector<std::size_t> & storage_index, const double r)
+    {
+        using boost::geometry::get;
+        if(r != radius) set_radius(r);
+        const std::size_t N = diploids.size(), ncells = std::size_t(G)*G;
+        cell_of.resize(N);
+        cell_start.assign(ncells+1,0);
+        for(std::size_t i = 0 ; i < N ; ++i)
+        {
+            cell_of[i] = coord(get<1>(diploids[i].v.first))*G + coord(get<0>(diploids[i].v.first));
+            cell_start[cell_of[i]+1]++;
+        }
+        for(std::size_t c = 0 ; c < ncells ; ++c) cell_start[c+1] += cell_start[c];
+        //counting sort, in birth order
+        members.resize(N);
+        next.assign(cell_start.begin(),cell_start.end()-1);
+        for(std::size_t b = 0 ; b < N ; ++b)
+        {
+            auto i = storage_index.empty() ? b : storage_index[b];
+            members[next[cell_of[i]]++] = i;
+        }
+        prob.resize(N);
+        alias.resize(N);
+        cell_w.assign(ncells,0.);
+        for(std::size_t c = 0 ; c < ncells ; ++c)
+        {
+            for(std::size_t j = cell_start[c] ; j < cell_start[c+1] ; ++j) cell_w[c] += fitnesses[members[j]];
+            build_alias(cell_start[c],cell_start[c+1],fitnesses);
+        }
+        neighbour_cumw.resize(9*ncells);
+        for(unsigned iy = 0 ; iy < G ; ++iy)
+        {
+            for(unsigned ix = 0 ; ix < G ; ++ix)
+            {
+                double * cw = &neighbour_cumw[9*(std::size_t(iy)*G + ix)];
+                double sum = 0.;
+                for(int k = 0 ; k < 9 ; ++k)
+                {
+                    int jx = int(ix) + k%3 - 1, jy = int(iy) + k/3 - 1;
+                    if(jx >= 0 && jy >= 0 && jx < int(G) && jy < int(G))
+                    {
+                        sum += overlap[k]*cell_w[std::size_t(jy)*G + std::size_t(jx)];
+                    }
+                    cw[k] = sum;
+                }
+            }
+        }
+    }
+
+    /* Pick parent 2 for the diploid stored at p1.
+     * Returns p1 if no one else could be picked,
+     * which only happens if nearby fitnesses are all 0.
+     */
+    inline std::size_t pick(const gsl_rng * r, const std::size_t p1) const
+    {
+        const std::size_t c = cell_of[p1];
+        const double * cw = &neighbour_cumw[9*c];
+        if(!(cw[8] > 0.)) return p1;
+        const double u = gsl_rng_uniform(r)*cw[8];
+        int k = 0;
+        while(k < 8 && !(u < cw[k])) ++k;
+        const std::size_t c2 = std::size_t(int(c) + (k/3 - 1)*int(G) + (k%3 - 1));
+        const std::size_t first = cell_start[c2], n = cell_start[c2+1] - first;
+        //One uniform gives both the slot and the coin flip
+        const double v = gsl_rng_uniform(r)*double(n);
+        std::size_t j = std::min(n-1,std::size_t(v));
+        j += first;
+        return (v - std::floor(v) < prob[j]) ? members[j] : members[alias[j]];
+    }
+
+    unsigned cells_per_side() const
+    {
+        return G;
+    }
+};
+}
+#endif
@@ -0,0 +1,190 @@
+#ifndef LANDSCAPE_DENSITY_HPP
+#define LANDSCAPE_DENSITY_HPP
+
+#include <vector>
+#include <cmath>
+#include <numeric>
+#include <algorithm>
+#include <boost/geometry/core/access.hpp>
+
+namespace landscape
+{
+/*
+ * Local population density on the [0,1]^2 landscape.
+ *
+ * The density experienced by diploid i is a Gaussian kernel
+ * with s.d. sigma summed over all diploids:
+ *
+ * D_i = sum_j exp(-d_ij^2/(2 sigma^2))/(2 pi sigma^2),
+ *
+ * i.e. individuals per unit area, smoothed over a
+ * neighbourhood of radius ~sigma.  Computing that
+ * with an rtree query per diploid costs O(N*k).
+ *
+ * Instead, we do it "particle-mesh" style, in one pass:
+ * 1. Diploids are deposited onto a grid with spacing sigma/2
+ *    by bilinear ("cloud in cell") weights.
+ * 2. The grid is convolved with the Gaussian kernel. The kernel
+ *    is separable, so this is two 1-d passes, each
+ *    with a stencil of 6 sigma.
+ * 3. D_i is the bilinear interpolation of the smoothed grid
+ *    at each diploid's position.
+ *
+ * The total cost is O(N + G^2), where G = # grid nodes per side.
+ * Note that D_i includes diploid i itself.
+ *
+ * Near an edge, part of the kernel falls outside the landscape, where
+ * no one can be, so the sum is divided by the kernel's mass inside
+ * [0,1]^2, and deposits on edge nodes, which only cover half a cell,
+ * are doubled.  Otherwise density would be underestimated along the edges,
+ * which is where update() piles up offspring that disperse off the landscape.
+ * The mass is a product of the masses inside [0,1] along x and y, so each
+ * 1-d pass divides by its own.
+ */
+class local_density
+{
+    std::vector<double> grid,temp,kernel;
+    //edge[i] = kernel mass over the mass inside [0,1], at node i
+    std::vector<double> edge;
+    unsigned G;  //# grid intervals per side.  There are G+1 nodes per side.
+    double h;    //grid spacing
+
+    inline void locate(double x, unsigned & i, double & t) const
+    {
+        double f = x/h;
+        if(f < 0.) f = 0.;
+        i = std::min(unsigned(f),G-1);
+        t = f - double(i);
+    }
+
+    inline double & node(unsigned ix, unsigned iy)
+    {
+        return grid[std::size_t(iy)*(G+1)+ix];
+    }
+public:
+    double sigma;
+    //Density at each diploid, in the order of the diploids container
+    std::vector<double> density;
+
+    explicit local_density(double sigma_) : grid(),temp(),kernel(),edge(),G(1),h(1.),sigma(sigma_),density()
+    {
+        //Spacing of sigma/2 is plenty for a Gaussian kernel.
+        //Cap the grid at 4096^2 nodes for tiny sigma.
+        G = unsigned(std::min(4096.,std::max(1.,std::ceil(2.0/sigma))));
+        h = 1.0/double(G);
+        const int M = int(std::ceil(3.0*sigma/h));
+        kernel.resize(2*M+1);
+        for(int m = -M ; m <= M ; ++m)
+        {
+            double d = double(m)*h;
+            kernel[m+M] = std::exp(-d*d/(2.0*sigma*sigma));
+        }
+        const double total = std::accumulate(kernel.begin(),kernel.end(),0.);
+        const int n = int(G+1);
+        edge.resize(G+1);
+        for(int i = 0 ; i < n ; ++i)
+        {
+            double inside = 0.;
+            for(int m = std::max(-M,-i) ; m <= std::min(M,n-1-i) ; ++m) inside += kernel[m+M];
+            edge[i] = total/inside;
+        }
+        grid.resize(std::size_t(G+1)*(G+1));
+        temp.resize(grid.size());
+    }
+
+    template<typename dipcont_t>
+    void compute(const dipcont_t & diploids)
+    {
+        using boost::geometry::get;
+        std::fill(grid.begin(),grid.end(),0.);
+        //1. deposit
+        for(const auto & dip : diploids)
+        {
+            unsigned ix,iy;
+            double tx,ty;
+            locate(get<0>(dip.v.first),ix,tx);
+            locate(get<1>(dip.v.first),iy,ty);
+            node(ix,iy) += (1.-tx)*(1.-ty);
+            node(ix+1,iy) += tx*(1.-ty);
+            node(ix,iy+1) += (1.-tx)*ty;
+            node(ix+1,iy+1) += tx*ty;
+        }
+        //Nodes on an edge only collect from half a cell on that axis
+        for(unsigned i = 0 ; i <= G ; ++i)
+        {
+            node(0,i) *= 2.;
+            node(G,i) *= 2.;
+        }
+        for(unsigned i = 0 ; i <= G ; ++i)
+        {
+            node(i,0) *= 2.;
+            node(i,G) *= 2.;
+        }
+        //2. convolve along x, into temp, then along y, back into grid
+        const int M = int(kernel.size()/2), n = int(G+1);
+        for(int iy = 0 ; iy < n ; ++iy)
+        {
+            for(int ix = 0 ; ix < n ; ++ix)
+            {
+                double s = 0.;
+                for(int m = std::max(-M,-ix) ; m <= std::min(M,n-1-ix) ; ++m)
+                {
+                    s += kernel[m+M]*grid[std::size_t(iy)*n+ix+m];
+                }
+                temp[std::size_t(iy)*n+ix] = s*edge[ix];
+            }
+        }
+        for(int iy = 0 ; iy < n ; ++iy)
+        {
+            for(int ix = 0 ; ix < n ; ++ix)
+            {
+                double s = 0.;
+                for(int m = std::max(-M,-iy) ; m <= std::min(M,n-1-iy) ; ++m)
+                {
+                    s += kernel[m+M]*temp[std::size_t(iy+m)*n+ix];
+                }
+                grid[std::size_t(iy)*n+ix] = s*edge[iy];
+            }
+        }
+        //3. interpolate
+        const double norm = 1.0/(2.0*M_PI*sigma*sigma);
+        density.resize(diploids.size());
+        for(std::size_t i = 0 ; i < diploids.size() ; ++i)
+        {
+            unsigned ix,iy;
+            double tx,ty;
+            locate(get<0>(diploids[i].v.first),ix,tx);
+            locate(get<1>(diploids[i].v.first),iy,ty);
+            density[i] = norm*((1.-tx)*(1.-ty)*node(ix,iy) + tx*(1.-ty)*node(ix+1,iy)
+                               + (1.-tx)*ty*node(ix,iy+1) + tx*ty*node(ix+1,iy+1));
+        }
+    }
+};
+
+/*
+ * Local Beverton-Holt regulation.
+ * Diploid i has expected # offspring
+ *
+ * lambda_i = R/(1 + (R-1) D_i/capacity),
+ *
+ * which is 1 when the local density D_i equals the carrying
+ * capacity (individuals per unit area), and R at low density.
+ * The lambda_i are written to modifiers, to be multiplied
+ * into the genetic fitnesses. The return value is the sum
+ * of the lambda_i, which is the expected size of the next
+ * generation.
+ */
+inline double beverton_holt(const local_density & d, const double R, const double capacity,
+                            std::vector<double> & modifiers)
+{
+    modifiers.resize(d.density.size());
+    double sum = 0.;
+    for(std::size_t i = 0 ; i < d.density.size() ; ++i)
+    {
+        modifiers[i] = R/(1. + (R - 1.)*d.density[i]/capacity);
+        sum += modifiers[i];
+    }
+    return sum;
+}
+}
+#endif
@@ -0,0 +1,102 @@
+#ifndef LANDSCAPE_FITNESS_SAMPLER_HPP
+#define LANDSCAPE_FITNESS_SAMPLER_HPP
+
+#include <vector>
+#include <cstddef>
+#include <cassert>
+#include <gsl/gsl_rng.h>
+
+namespace landscape
+{
+/*
+ * Dynamic fitness-proportional sampler.
+ *
+ * The gsl_ran_discrete lookup used by WFLandscapeRules::w is O(1) to
+ * sample from, but O(N) to build, so it is no good when fitnesses change
+ * one individual at a time.  This is a Fenwick (binary indexed) tree
+ * over the weights: setting a weight and sampling are both O(log N).
+ */
+class fitness_sampler
+{
+    std::vector<double> weights, tree;
+    std::size_t mask; //largest power of 2 <= size
+    void set_mask()
+    {
+        mask = 1;
+        while((mask<<1) <= weights.size()) mask <<= 1;
+        if(weights.empty()) mask = 0;
+    }
+public:
+    fitness_sampler() : weights(), tree(1, 0.), mask(0)
+    {
+    }
+
+    std::size_t size() const
+    {
+        return weights.size();
+    }
+
+    double weight(std::size_t i) const
+    {
+        return weights[i];
+    }
+
+    //Grow to n slots.  New slots have weight 0.
+    void resize(std::size_t n)
+    {
+        if(n <= weights.size()) return;
+        weights.resize(n, 0.);
+        rebuild();
+    }
+
+    //O(N) construction from the current weights.
+    //Also used to discard accumulated rounding error.
+    void rebuild()
+    {
+        tree.assign(weights.size() + 1, 0.);
+        for(std::size_t i = 1 ; i <= weights.size() ; ++i)
+        {
+            tree[i] += weights[i - 1];
+            auto parent = i + (i & (~i + 1));
+            if(parent <= weights.size()) tree[parent] += tree[i];
+        }
+        set_mask();
+    }
+
+    void set(std::size_t i, double w)
+    {
+        assert(i < weights.size());
+        assert(w >= 0.);
+        const double delta = w - weights[i];
+        weights[i] = w;
+        for(std::size_t j = i + 1 ; j < tree.size() ; j += (j & (~j + 1))) tree[j] += delta;
+    }
+
+    double total() const
+    {
+        double s = 0.;
+        for(std::size_t j = weights.size() ; j > 0 ; j -= (j & (~j + 1))) s += tree[j];
+        return s;
+    }
+
+    //Returns index i with probability weight(i)/total().
+    std::size_t sample(const gsl_rng * r) const
+    {
+        double u = gsl_rng_uniform(r)*total();
+        std::size_t pos = 0;
+        for(std::size_t step = mask ; step ; step >>= 1)
+        {
+            if(pos + step < tree.size() && tree[pos + step] <= u)
+            {
+                pos += step;
+                u -= tree[pos];
+            }
+        }
+        //Rounding can walk us past the last non-zero weight
+        if(pos >= weights.size()) pos = weights.size() - 1;
+        while(pos > 0 && weights[pos] == 0.) --pos;
+        return pos;
+    }
+};
+}
+#endif
@@ -0,0 +1,114 @@
+/*
+ * Checks that calling update_mutations only when needed (fixations.hpp)
+ * gives the same population as calling it every generation.
+ *
+ * Two copies of the same simulation (simulation.hpp) are run side by
+ * side from the same seed, one with adaptive_prune and one without.  After
+ * each generation, their fixations, fixation times, mutation lookup tables,
+ * mutation counts and mutations are compared.  Any difference is printed,
+ * and the exit status is then 1.
+ *
+ * Small N and large theta give many fixations to check.
+ */
+#include "simulation.hpp"
+#include "options.hpp"
+#include <cassert> //fwdpp has this missing in one of its headers...
+#include <cstdlib>
+#include <chrono>
+#include <iostream>
+
+using simulation_type = landscape::landscape_simulation<>;
+
+//The first way in which a and b differ, or an empty string
+std::string difference(const landscape::poptype & a, const landscape::poptype & b)
+{
+    if(a.fixations.size() != b.fixations.size()) return "# fixations";
+    for(std::size_t i = 0 ; i < a.fixations.size() ; ++i)
+    {
+        if(a.fixations[i].pos != b.fixations[i].pos || a.fixations[i].s != b.fixations[i].s ||
+                a.fixations[i].g != b.fixations[i].g) return "fixation " + std::to_string(i);
+    }
+    if(a.fixation_times != b.fixation_times) return "fixation times";
+    if(a.mut_lookup != b.mut_lookup) return "mutation lookup";
+    if(a.mcounts != b.mcounts) return "mutation counts";
+    if(a.mutations.size() != b.mutations.size()) return "# mutations";
+    for(std::size_t i = 0 ; i < a.mutations.size() ; ++i)
+    {
+        if(a.mutations[i].pos != b.mutations[i].pos) return "mutation " + std::to_string(i);
+    }
+    return std::string();
+}
+
+int main(int argc, char ** argv)
+{
+    if(argc<5)
+    {
+        std::cerr << "Incorrect number of arguments.\n"
+                  << "Usage:\n"
+                  << argv[0] << ' '
+                  << "N "
+                  << "theta "
+                  << "seed "
+                  << "generations\n"
+                  << "\n"
+                  << "Output lines are: differ generation what, for each generation in which the two differ,\n"
+                  << "then: fixations n, update_mutations calls skipped, and seconds adaptive always\n"
+                  << "\n"
+                  << "Optional arguments, given as name=value after generations:\n"
+                  << "rho = 4Nr (default 10)\n"
+                  << "s = selection coefficient (default -0.01)\n"
+                  << "mu = mutation rate to selected variants (default 0.001)\n"
+                  << "radius = mating radius (default 0.1)\n"
+                  << "dispersal = dispersal s.d. (default 0.05)\n";
+        exit(0);
+    }
+    int argn = 1;
+    landscape::landscape_params p;
+    p.N = atoi(argv[argn++]);
+    p.theta = atof(argv[argn++]);
+    const unsigned seed = atoi(argv[argn++]);
+    const unsigned generations = atoi(argv[argn++]);
+
+    landscape::options opts(argc,argv,argn);
+    p.rho = opts.get("rho",10.);
+    p.s = opts.get("s",-0.01);
+    p.h = 1.;
+    p.mu = opts.get("mu",0.001);
+    p.radius = opts.get("radius",0.1);
+    p.dispersal = opts.get("dispersal",0.05);
+    opts.check();
+    if(!p.N)
+    {
+        std::cerr << "Error: need N > 0\n";
+        exit(1);
+    }
+
+    landscape::landscape_params q(p);
+    p.adaptive_prune = true;
+    q.adaptive_prune = false;
+    simulation_type adaptive(p,seed), always(q,seed);
+    double seconds[2] = {0.,0.};
+    unsigned ndiffer = 0;
+    for(unsigned g = 0 ; g < generations ; ++g)
+    {
+        //Whichever runs first in a generation is slower, so they take turns
+        for(int i = 0 ; i < 2 ; ++i)
+        {
+            const int which = (g+i)%2;
+            auto start = std::chrono::steady_clock::now();
+            (which ? always : adaptive).step();
+            seconds[which] += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        }
+        const auto d = difference(adaptive.population(),always.population());
+        if(!d.empty())
+        {
+            std::cout << "differ " << g << ' ' << d << '\n';
+            ++ndiffer;
+        }
+    }
+    const auto & schedule = adaptive.fixation_scheduling();
+    std::cout << "fixations " << adaptive.population().fixations.size() << '\n'
+              << "update_mutations " << schedule.nfull << ' ' << schedule.nskipped << '\n'
+              << "seconds " << seconds[0] << ' ' << seconds[1] << '\n';
+    return ndiffer ? 1 : 0;
+}
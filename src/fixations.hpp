@@ -0,0 +1,88 @@
+#ifndef LANDSCAPE_FIXATIONS_HPP
+#define LANDSCAPE_FIXATIONS_HPP
+
+#include <vector>
+#include <cstddef>
+#include <fwdpp/diploid.hh>
+
+namespace landscape
+{
+/*
+ * When to call KTfwd::update_mutations.
+ *
+ * update_mutations moves mutations with a count of 2N to pop.fixations,
+ * and erases the position of every mutation with a count of 0 from
+ * pop.mut_lookup, which infsites uses to keep positions unique.  It does that
+ * every generation, so the mutations that were lost long ago, whose slots
+ * are waiting to be recycled, are erased from the hash table over and over.
+ *
+ * A fixation has to be recorded in the generation it happens in:
+ * sample_diploid takes fixed mutations out of the gametes, so their
+ * count is 0 by the next generation.  And a lost mutation's position has
+ * to be gone from mut_lookup before the next generation's mutations are made,
+ * or infsites could draw different positions.
+ *
+ * So, each generation, fixation_schedule makes one pass over mcounts, with
+ * no hashing except for mutations lost since the last generation, whose
+ * positions are erased, which is what update_mutations would have changed.
+ * If the pass finds a count of 2N, or if every > 0 and it has been "every"
+ * generations since the last time, update_mutations is called.  Fixations,
+ * their times, and mut_lookup are then the same as if update_mutations were
+ * called every generation.
+ *
+ * live[i] is whether mutation slot i had a nonzero count at the last call.
+ * Slots it does not know about are taken to be live, so after reset() the
+ * next call erases every lost position, as update_mutations does.
+ */
+class fixation_schedule
+{
+    unsigned every,next;
+    std::vector<char> live;
+public:
+    //# of calls to update_mutations, and of generations that did without
+    std::size_t nfull,nskipped;
+
+    explicit fixation_schedule(const unsigned every_ = 0) : every(every_),next(0),live(),nfull(0),nskipped(0)
+    {
+    }
+
+    //Call instead of update_mutations, with the same arguments.
+    //Returns true if update_mutations was called.
+    template<typename poptype>
+    bool operator()(poptype & pop, const unsigned generation, const unsigned twoN)
+    {
+        live.resize(pop.mcounts.size(),1);
+        bool full = every && generation >= next;
+        //Stops at a fixation, as update_mutations then does the rest
+        for(std::size_t i = 0 ; i < pop.mcounts.size() && !full ; ++i)
+        {
+            const auto c = pop.mcounts[i];
+            if(c == twoN) full = true;
+            else if(c) live[i] = 1;
+            else if(live[i])
+            {
+                pop.mut_lookup.erase(pop.mutations[i].pos);
+                live[i] = 0;
+            }
+        }
+        if(full)
+        {
+            KTfwd::update_mutations(pop.mutations,pop.fixations,pop.fixation_times,pop.mut_lookup,pop.mcounts,generation,twoN);
+            for(std::size_t i = 0 ; i < pop.mcounts.size() ; ++i) live[i] = pop.mcounts[i] != 0;
+            next = generation + every;
+            ++nfull;
+            return true;
+        }
+        ++nskipped;
+        return false;
+    }
+
+    //Forget which mutations were live.  Call this after compact()
+    //renumbers the mutations, or after calling update_mutations directly.
+    void reset()
+    {
+        live.clear();
+    }
+};
+}
+#endif
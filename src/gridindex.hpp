@@ -0,0 +1,231 @@
+#ifndef LANDSCAPE_GRIDINDEX_HPP
+#define LANDSCAPE_GRIDINDEX_HPP
+
+#include <vector>
+#include <cmath>
+#include <cstddef>
+#include <algorithm>
+#include <boost/geometry/core/access.hpp>
+
+namespace landscape
+{
+/*
+ * A uniform grid over the unit square, as an alternative to the
+ * rtree for points spread over the whole landscape.  Values are
+ * the same as the rtree's, i.e. (point, label) pairs (see simtypes.hpp).
+ *
+ * Each cell holds the values whose points fall in it, and a query
+ * visits the cells that overlap its region.  With cells about the size of
+ * the mating radius, a radius query looks at 9 cells whatever N is, and
+ * building the index is O(N) with no rebalancing.  Clustered points
+ * make some cells very full, which is where an rtree does better.
+ * rtree_bench.cc compares the two.
+ *
+ * Points outside [0,1]^2 go in the nearest edge cell.  Results come back
+ * in cell order, not in any order an rtree would use.
+ */
+template<typename value_t>
+class grid_index
+{
+    unsigned G; //# cells per side
+    double h;   //cell size
+    std::vector<std::vector<value_t>> cells;
+    std::size_t n;
+    //Re-used by nearest, which is why nearest may not
+    //be called by several threads at once
+    mutable std::vector<std::pair<double,const value_t *>> candidates;
+
+    static inline double x_of(const value_t & v)
+    {
+        return boost::geometry::get<0>(v.first);
+    }
+    static inline double y_of(const value_t & v)
+    {
+        return boost::geometry::get<1>(v.first);
+    }
+    inline unsigned coord(const double x) const
+    {
+        auto c = (x > 0.) ? unsigned(x/h) : 0u;
+        return (c >= G) ? G-1 : c;
+    }
+    inline std::vector<value_t> & cell_of(const value_t & v)
+    {
+        return cells[std::size_t(coord(y_of(v)))*G + coord(x_of(v))];
+    }
+    static inline bool same(const value_t & a, const value_t & b)
+    {
+        return a.second == b.second && x_of(a) == x_of(b) && y_of(a) == y_of(b);
+    }
+public:
+    using value_type = value_t;
+
+    //Cells are at least cell_size on a side, and there are at most 4096^2 of them
+    explicit grid_index(const double cell_size = 0.05) :
+        G(unsigned(std::max(1.,std::min(4096.,std::floor(1.0/cell_size))))),
+        h(1.0/double(G)),cells(std::size_t(G)*G),n(0),candidates()
+    {
+    }
+
+    //Bulk load from a range of values
+    template<typename iterator>
+    grid_index(iterator first, iterator last, const double cell_size = 0.05) : grid_index(cell_size)
+    {
+        rebuild(first,last);
+    }
+
+    //Replace the contents with a range of values, keeping the cells.
+    //Rebuilding from cell_size() instead could lose a cell to rounding.
+    template<typename iterator>
+    void rebuild(iterator first, iterator last)
+    {
+        clear();
+        std::vector<std::size_t> counts(cells.size(),0);
+        for(auto i = first ; i != last ; ++i) counts[std::size_t(coord(y_of(*i)))*G + coord(x_of(*i))]++;
+        for(std::size_t c = 0 ; c < cells.size() ; ++c) cells[c].reserve(counts[c]);
+        for( ; first != last ; ++first) insert(*first);
+    }
+
+    inline void insert(const value_t & v)
+    {
+        cell_of(v).push_back(v);
+        ++n;
+    }
+
+    //Remove a value equal to v, if there is one.  Returns 1 if
+    //a value was removed, else 0, as an rtree does.
+    std::size_t remove(const value_t & v)
+    {
+        auto & c = cell_of(v);
+        for(std::size_t i = 0 ; i < c.size() ; ++i)
+        {
+            if(same(c[i],v))
+            {
+                c[i] = c.back();
+                c.pop_back();
+                --n;
+                return 1;
+            }
+        }
+        return 0;
+    }
+
+    void clear()
+    {
+        for(auto & c : cells) c.clear();
+        n = 0;
+    }
+
+    std::size_t size() const
+    {
+        return n;
+    }
+
+    bool empty() const
+    {
+        return n == 0;
+    }
+
+    double cell_size() const
+    {
+        return h;
+    }
+
+    //Values within the closed box (xmin,ymin) to (xmax,ymax)
+    template<typename output_iterator>
+    void query_box(const double xmin, const double ymin, const double xmax, const double ymax,
+                   output_iterator out) const
+    {
+        query_box(xmin,ymin,xmax,ymax,out,[](const value_t &) {
+            return true;
+        });
+    }
+
+    //The same, but only values for which pred(value) is true
+    template<typename output_iterator,typename predicate>
+    void query_box(const double xmin, const double ymin, const double xmax, const double ymax,
+                   output_iterator out, const predicate & pred) const
+    {
+        const unsigned x0 = coord(xmin), x1 = coord(xmax), y0 = coord(ymin), y1 = coord(ymax);
+        for(unsigned iy = y0 ; iy <= y1 ; ++iy)
+        {
+            for(unsigned ix = x0 ; ix <= x1 ; ++ix)
+            {
+                for(const auto & v : cells[std::size_t(iy)*G + ix])
+                {
+                    const double x = x_of(v), y = y_of(v);
+                    if(x >= xmin && x <= xmax && y >= ymin && y <= ymax && pred(v)) *out++ = v;
+                }
+            }
+        }
+    }
+
+    //Values within Euclidean distance r of (x,y)
+    template<typename output_iterator>
+    void query_radius(const double x, const double y, const double r, output_iterator out) const
+    {
+        const unsigned x0 = coord(x-r), x1 = coord(x+r), y0 = coord(y-r), y1 = coord(y+r);
+        const double r2 = r*r;
+        for(unsigned iy = y0 ; iy <= y1 ; ++iy)
+        {
+            for(unsigned ix = x0 ; ix <= x1 ; ++ix)
+            {
+                for(const auto & v : cells[std::size_t(iy)*G + ix])
+                {
+                    const double dx = x - x_of(v), dy = y - y_of(v);
+                    if(dx*dx + dy*dy <= r2) *out++ = v;
+                }
+            }
+        }
+    }
+
+    //The k values nearest to (x,y), nearest first.  Rings of cells
+    //are searched outward from the cell of (x,y) until the next ring
+    //cannot hold anything nearer than the k-th nearest found so far.
+    template<typename output_iterator>
+    void nearest(const double x, const double y, const std::size_t k, output_iterator out) const
+    {
+        candidates.clear();
+        if(!k || !n) return;
+        const int cx = int(coord(x)), cy = int(coord(y));
+        auto visit = [this,x,y](const int ix, const int iy) {
+            if(ix < 0 || iy < 0 || ix >= int(G) || iy >= int(G)) return;
+            for(const auto & v : cells[std::size_t(iy)*G + std::size_t(ix)])
+            {
+                const double dx = x - x_of(v), dy = y - y_of(v);
+                candidates.emplace_back(dx*dx + dy*dy,&v);
+            }
+        };
+        for(int d = 0 ; d < int(G) ; ++d)
+        {
+            if(!d) visit(cx,cy);
+            for(int i = -d ; d && i <= d ; ++i)
+            {
+                visit(cx+i,cy-d);
+                visit(cx+i,cy+d);
+                if(i != -d && i != d)
+                {
+                    visit(cx-d,cy+i);
+                    visit(cx+d,cy+i);
+                }
+            }
+            if(candidates.size() >= k)
+            {
+                //Anything in ring d+1 is at least d cells away
+                std::nth_element(candidates.begin(),candidates.begin()+std::ptrdiff_t(k-1),candidates.end(),
+                [](const std::pair<double,const value_t *> & a, const std::pair<double,const value_t *> & b) {
+                    return a.first < b.first;
+                });
+                const double bound = double(d)*h;
+                if(candidates[k-1].first <= bound*bound) break;
+            }
+        }
+        const std::size_t m = std::min(k,candidates.size());
+        std::partial_sort(candidates.begin(),candidates.begin()+std::ptrdiff_t(m),candidates.end(),
+        [](const std::pair<double,const value_t *> & a, const std::pair<double,const value_t *> & b) {
+            return a.first < b.first;
+        });
+        for(std::size_t i = 0 ; i < m ; ++i) *out++ = *candidates[i].second;
+    }
+};
+}
+#endif
@@ -0,0 +1,146 @@
+#ifndef LANDSCAPE_INDEXQUERY_HPP
+#define LANDSCAPE_INDEXQUERY_HPP
+
+#include <cmath>
+#include <cstddef>
+#include <boost/geometry.hpp>
+#include <boost/geometry/index/rtree.hpp>
+#include "gridindex.hpp"
+
+namespace landscape
+{
+/*
+ * The spatial queries that the rules (wfrules.hpp), the statistics
+ * (spatialstats.hpp) and reorder.hpp make of an index.
+ *
+ * The generic versions use the API of boost::geometry's rtree.  Other
+ * indexes overload them, as grid_index does below, and adaptive_index does
+ * in autotune.hpp.  Results may come back in any order, and callers
+ * that care about order sort them.  Points on the edge of a box are in it.
+ */
+
+//Values in the box from lo to hi for which pred(value) is true
+template<typename index_t,typename point_t,typename predicate,typename output_iterator>
+inline void query_box(const index_t & index, const point_t & lo, const point_t & hi,
+                      const predicate & pred, output_iterator out)
+{
+    namespace bgi = boost::geometry::index;
+    index.query(bgi::intersects(boost::geometry::model::box<point_t>(lo,hi)) && bgi::satisfies(pred),out);
+}
+
+//All values in the box from lo to hi
+template<typename index_t,typename point_t,typename output_iterator>
+inline void query_box(const index_t & index, const point_t & lo, const point_t & hi, output_iterator out)
+{
+    namespace bgi = boost::geometry::index;
+    index.query(bgi::intersects(boost::geometry::model::box<point_t>(lo,hi)),out);
+}
+
+//The k values nearest to p.  Which of several values tied for k-th
+//nearest is returned depends on the index.
+template<typename index_t,typename point_t,typename output_iterator>
+inline void query_nearest(const index_t & index, const point_t & p, const std::size_t k, output_iterator out)
+{
+    namespace bgi = boost::geometry::index;
+    index.query(bgi::nearest(p,unsigned(k)),out);
+}
+
+namespace detail
+{
+//True for values within dmax of (x,y)
+struct within_distance
+{
+    double x,y,dmax;
+    template<typename value_t>
+    bool operator()(const value_t & v) const
+    {
+        return std::sqrt(std::pow(x-boost::geometry::get<0>(v.first),2.0)
+                         +std::pow(y-boost::geometry::get<1>(v.first),2.0)) <= dmax;
+    }
+};
+
+//Output iterator that passes on the values for which pred is true
+template<typename predicate,typename output_iterator>
+struct filtered_output
+{
+    predicate pred;
+    output_iterator out;
+    filtered_output & operator*()
+    {
+        return *this;
+    }
+    filtered_output & operator++()
+    {
+        return *this;
+    }
+    filtered_output & operator++(int)
+    {
+        return *this;
+    }
+    template<typename value_t>
+    filtered_output & operator=(const value_t & v)
+    {
+        if(pred(v)) *out++ = v;
+        return *this;
+    }
+};
+}
+
+//The k values nearest to p, out of those within dmax of p
+template<typename index_t,typename point_t,typename output_iterator>
+inline void query_nearest(const index_t & index, const point_t & p, const std::size_t k, const double dmax,
+                          output_iterator out)
+{
+    namespace bgi = boost::geometry::index;
+    const detail::within_distance pred{boost::geometry::get<0>(p),boost::geometry::get<1>(p),dmax};
+    index.query(bgi::nearest(p,unsigned(k)) && bgi::satisfies(pred),out);
+}
+
+//Replace the contents of index with [first,last), bulk loading if possible
+template<typename index_t,typename iterator>
+inline void rebuild_index(index_t & index, iterator first, iterator last)
+{
+    index = index_t(first,last);
+}
+
+template<typename value_t,typename point_t,typename predicate,typename output_iterator>
+inline void query_box(const grid_index<value_t> & index, const point_t & lo, const point_t & hi,
+                      const predicate & pred, output_iterator out)
+{
+    using boost::geometry::get;
+    index.query_box(get<0>(lo),get<1>(lo),get<0>(hi),get<1>(hi),out,pred);
+}
+
+template<typename value_t,typename point_t,typename output_iterator>
+inline void query_box(const grid_index<value_t> & index, const point_t & lo, const point_t & hi, output_iterator out)
+{
+    using boost::geometry::get;
+    index.query_box(get<0>(lo),get<1>(lo),get<0>(hi),get<1>(hi),out);
+}
+
+template<typename value_t,typename point_t,typename output_iterator>
+inline void query_nearest(const grid_index<value_t> & index, const point_t & p, const std::size_t k, output_iterator out)
+{
+    using boost::geometry::get;
+    index.nearest(get<0>(p),get<1>(p),k,out);
+}
+
+//Everything nearer than the k-th nearest value is within dmax if it is,
+//so this is the same set as the k nearest of those within dmax.
+template<typename value_t,typename point_t,typename output_iterator>
+inline void query_nearest(const grid_index<value_t> & index, const point_t & p, const std::size_t k, const double dmax,
+                          output_iterator out)
+{
+    using boost::geometry::get;
+    const detail::within_distance pred{get<0>(p),get<1>(p),dmax};
+    index.nearest(get<0>(p),get<1>(p),k,detail::filtered_output<detail::within_distance,output_iterator> {pred,out});
+}
+
+//Keeps the cells
+template<typename value_t,typename iterator>
+inline void rebuild_index(grid_index<value_t> & index, iterator first, iterator last)
+{
+    index.rebuild(first,last);
+}
+}
+#endif
@@ -0,0 +1,362 @@
+#ifndef LANDSCAPE_INITIAL_HPP
+#define LANDSCAPE_INITIAL_HPP
+
+#include <map>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <gsl/gsl_rng.h>
+#include <gsl/gsl_randist.h>
+#include <fwdpp/internal/gsl_discrete.hpp>
+#include <fwdpp/sugar/popgenmut.hpp>
+#include "simtypes.hpp"
+
+namespace landscape
+{
+/*
+ * The initial landscape: where diploids are at the start of a simulation,
+ * and, optionally, their genotypes.  It is given by a "spec" string:
+ *
+ * quadrants: 1/2 of diploids uniform in the upper left quadrant, 1/2 in the lower right.
+ *            This is what the programs have always done, and is the default.
+ * uniform: uniform on [0,1]^2.
+ * clustered:k:sigma: k cluster centres uniform on the landscape.  Each diploid
+ *            is at a random centre + Gaussian noise with s.d. sigma, clamped to [0,1].
+ * raster:filename: density proportional to a raster, i.e. a text file with the # of
+ *            columns and rows, then the rows of non-negative weights.  The first row is
+ *            the top (y near 1) of the landscape.  Diploids are uniform within a cell.
+ * file:filename: coordinates, and optionally genotypes, from a binary file (see below),
+ *            which is memory mapped.
+ *
+ * initial_landscape fills in pop.diploids[i].v and the values vector,
+ * which is then used to bulk-load the rtree in one pass.
+ *
+ * The binary file format is:
+ * 8 byte magic "LSCOORD1", uint64 N, uint64 flags,
+ * N x (double x, double y),
+ * and then, if flags & 1, the genotypes of the N diploids:
+ * 2N x (uint32 # mutations, that many x (double pos, double s)).
+ * Mutations with s == 0 are neutral.  Mutations at the same position are the same mutation,
+ * and they get the dominance and origin time passed to initial_landscape.
+ * Numbers are in the byte order of the machine that wrote the file.
+ * write_initial_landscape writes this format.
+ */
+namespace detail
+{
+const char coord_magic[] = "LSCOORD1";
+
+//Read-only memory map of a whole file
+class mapped_file
+{
+    void * addr;
+    std::size_t len;
+public:
+    explicit mapped_file(const std::string & filename) : addr(MAP_FAILED),len(0)
+    {
+        int fd = ::open(filename.c_str(),O_RDONLY);
+        if(fd < 0) throw std::runtime_error("could not open " + filename);
+        struct stat st;
+        if(fstat(fd,&st) || st.st_size == 0)
+        {
+            ::close(fd);
+            throw std::runtime_error(filename + " is empty or could not be read");
+        }
+        len = std::size_t(st.st_size);
+        addr = mmap(nullptr,len,PROT_READ,MAP_PRIVATE,fd,0);
+        ::close(fd);
+        if(addr == MAP_FAILED) throw std::runtime_error("could not memory map " + filename);
+        //we read it front to back
+        madvise(addr,len,MADV_SEQUENTIAL);
+    }
+
+    mapped_file(const mapped_file &) = delete;
+    mapped_file & operator=(const mapped_file &) = delete;
+
+    ~mapped_file()
+    {
+        if(addr != MAP_FAILED) munmap(addr,len);
+    }
+
+    const char * data() const
+    {
+        return static_cast<const char *>(addr);
+    }
+
+    std::size_t size() const
+    {
+        return len;
+    }
+};
+
+//Sequential reads from a memory map, with bounds checking
+struct map_reader
+{
+    const char * p;
+    const char * end;
+    template<typename T>
+    T get()
+    {
+        if(p + sizeof(T) > end) throw std::runtime_error("initial landscape file is truncated");
+        T t;
+        std::memcpy(&t,p,sizeof(T));
+        p += sizeof(T);
+        return t;
+    }
+};
+
+inline double clamp01(double x)
+{
+    return (x < 0.) ? 0. : ((x > 1.) ? 1. : x);
+}
+
+//Genotypes from the file become gametes + mutations.
+//Identical chromosomes share a gamete.
+template<typename poptype>
+void read_genotypes(map_reader & in, poptype & pop, const double h, const unsigned origin)
+{
+    using gamete_t = typename decltype(pop.gametes)::value_type;
+    const std::size_t N = pop.diploids.size();
+    std::map<double,std::size_t> mutation_at;
+    std::map<std::vector<std::size_t>,std::size_t> gamete_of;
+    pop.gametes.clear();
+    pop.mutations.clear();
+    pop.mut_lookup.clear();
+    std::vector<std::size_t> keys;
+    for(std::size_t i = 0 ; i < 2*N ; ++i)
+    {
+        const auto n = in.get<std::uint32_t>();
+        keys.clear();
+        for(std::uint32_t j = 0 ; j < n ; ++j)
+        {
+            const double pos = in.get<double>(), s = in.get<double>();
+            auto m = mutation_at.find(pos);
+            if(m == mutation_at.end())
+            {
+                m = mutation_at.emplace(pos,pop.mutations.size()).first;
+                pop.mutations.emplace_back(pos,s,h,origin);
+                pop.mut_lookup.insert(pos);
+            }
+            keys.push_back(m->second);
+        }
+        std::sort(keys.begin(),keys.end(),[&pop](std::size_t a, std::size_t b) {
+            return pop.mutations[a].pos < pop.mutations[b].pos;
+        });
+        keys.erase(std::unique(keys.begin(),keys.end()),keys.end());
+        auto g = gamete_of.find(keys);
+        if(g == gamete_of.end())
+        {
+            g = gamete_of.emplace(keys,pop.gametes.size()).first;
+            gamete_t gam(0);
+            for(const auto k : keys)
+            {
+                if(pop.mutations[k].neutral) gam.mutations.push_back(k);
+                else gam.smutations.push_back(k);
+            }
+            pop.gametes.push_back(gam);
+        }
+        pop.gametes[g->second].n++;
+        if(i%2) pop.diploids[i/2].second = g->second;
+        else pop.diploids[i/2].first = g->second;
+    }
+    pop.mcounts.assign(pop.mutations.size(),0);
+    for(const auto & gam : pop.gametes)
+    {
+        for(const auto k : gam.mutations) pop.mcounts[k] += gam.n;
+        for(const auto k : gam.smutations) pop.mcounts[k] += gam.n;
+    }
+}
+
+//Split a spec like clustered:10:0.05 at the colons
+inline std::vector<std::string> split_spec(const std::string & spec)
+{
+    std::vector<std::string> fields;
+    std::size_t start = 0, colon;
+    while((colon = spec.find(':',start)) != std::string::npos)
+    {
+        fields.push_back(spec.substr(start,colon-start));
+        start = colon+1;
+    }
+    fields.push_back(spec.substr(start));
+    return fields;
+}
+
+inline double spec_number(const std::string & field, const std::string & spec)
+{
+    std::istringstream in(field);
+    double x;
+    if(!(in >> x)) throw std::runtime_error("could not parse " + field + " in initial landscape " + spec);
+    return x;
+}
+}
+
+/* Place pop.diploids according to spec, and fill values with their
+ * rtree values.  pop.diploids must already be the right size.
+ * h and origin are the dominance and origin time of mutations
+ * read from a file.  Throws std::runtime_error on a bad spec or file.
+ */
+template<typename poptype>
+void initial_landscape(const std::string & spec, const gsl_rng * r, poptype & pop,
+                       std::vector<csdiploid::value> & values,
+                       const double h = 1.0, const unsigned origin = 0)
+{
+    using point = csdiploid::point;
+    const std::size_t N = pop.diploids.size();
+    values.resize(N);
+    auto place = [&pop,&values](std::size_t i, double x, double y) {
+        pop.diploids[i].v = csdiploid::value(std::make_pair(point(x,y),i));
+        values[i] = pop.diploids[i].v;
+    };
+    const auto fields = detail::split_spec(spec);
+    const std::string & kind = fields[0];
+    if(kind == "quadrants" && fields.size() == 1)
+    {
+        for(std::size_t i=0; i<N; ++i)
+        {
+            double x=0.0,y=0.0;
+            if(i<N/2)
+            {
+                x = gsl_ran_flat(r,0.,0.5);
+                y = gsl_ran_flat(r,0.5,1.);
+            }
+            else
+            {
+                x = gsl_ran_flat(r,0.5,1);
+                y = gsl_ran_flat(r,0.,0.5);
+            }
+            place(i,x,y);
+        }
+    }
+    else if(kind == "uniform" && fields.size() == 1)
+    {
+        for(std::size_t i=0; i<N; ++i)
+        {
+            double x = gsl_rng_uniform(r);
+            place(i,x,gsl_rng_uniform(r));
+        }
+    }
+    else if(kind == "clustered" && fields.size() == 3)
+    {
+        const auto k = std::size_t(detail::spec_number(fields[1],spec));
+        const double sigma = detail::spec_number(fields[2],spec);
+        if(!k || sigma < 0.) throw std::runtime_error("bad initial landscape " + spec);
+        std::vector<double> centres(2*k);
+        for(auto & c : centres) c = gsl_rng_uniform(r);
+        for(std::size_t i=0; i<N; ++i)
+        {
+            const auto c = gsl_rng_uniform_int(r,k);
+            double x = detail::clamp01(centres[2*c] + gsl_ran_gaussian(r,sigma));
+            place(i,x,detail::clamp01(centres[2*c+1] + gsl_ran_gaussian(r,sigma)));
+        }
+    }
+    else if(kind == "raster" && fields.size() == 2)
+    {
+        std::ifstream in(fields[1]);
+        std::size_t nx = 0, ny = 0;
+        if(!(in >> nx >> ny) || !nx || !ny) throw std::runtime_error("could not read raster " + fields[1]);
+        std::vector<double> w(nx*ny);
+        for(auto & wi : w)
+        {
+            if(!(in >> wi) || wi < 0.) throw std::runtime_error("bad or missing weights in raster " + fields[1]);
+        }
+        KTfwd::fwdpp_internal::gsl_ran_discrete_t_ptr lookup(gsl_ran_discrete_preproc(w.size(),w.data()));
+        if(!lookup) throw std::runtime_error("raster " + fields[1] + " has no positive weights");
+        for(std::size_t i=0; i<N; ++i)
+        {
+            const auto cell = gsl_ran_discrete(r,lookup.get());
+            //row 0 is the top
+            const double cx = double(cell%nx), cy = double(ny - 1 - cell/nx);
+            double x = (cx + gsl_rng_uniform(r))/double(nx);
+            place(i,x,(cy + gsl_rng_uniform(r))/double(ny));
+        }
+    }
+    else if(kind == "file" && fields.size() == 2)
+    {
+        detail::mapped_file f(fields[1]);
+        detail::map_reader in{f.data(),f.data()+f.size()};
+        char magic[8];
+        for(auto & c : magic) c = in.get<char>();
+        if(std::memcmp(magic,detail::coord_magic,8)) throw std::runtime_error(fields[1] + " is not an initial landscape file");
+        const auto n = in.get<std::uint64_t>(), flags = in.get<std::uint64_t>();
+        if(n != N)
+        {
+            std::ostringstream msg;
+            msg << fields[1] << " has " << n << " diploids, but the population size is " << N;
+            throw std::runtime_error(msg.str());
+        }
+        for(std::size_t i=0; i<N; ++i)
+        {
+            double x = in.get<double>(), y = in.get<double>();
+            //Also false for NaN
+            if(!(x >= 0. && x <= 1. && y >= 0. && y <= 1.))
+            {
+                std::ostringstream msg;
+                msg << fields[1] << ": the coordinates of diploid " << i << " are not in [0,1]";
+                throw std::runtime_error(msg.str());
+            }
+            place(i,x,y);
+        }
+        if(flags & 1) detail::read_genotypes(in,pop,h,origin);
+    }
+    else
+    {
+        throw std::runtime_error("unknown initial landscape " + spec);
+    }
+}
+
+//Write the coordinates, and optionally genotypes, of pop in the format read by "file:"
+template<typename poptype>
+void write_initial_landscape(const std::string & filename, const poptype & pop, const bool genotypes)
+{
+    std::FILE * f = std::fopen(filename.c_str(),"wb");
+    if(f == nullptr) throw std::runtime_error("could not open " + filename + " for writing");
+    std::vector<char> buffer(detail::coord_magic,detail::coord_magic+8);
+    auto put = [&buffer](const void * p, std::size_t n) {
+        buffer.insert(buffer.end(),static_cast<const char *>(p),static_cast<const char *>(p)+n);
+    };
+    const std::uint64_t n = pop.diploids.size(), flags = genotypes ? 1 : 0;
+    put(&n,sizeof(n));
+    put(&flags,sizeof(flags));
+    for(const auto & dip : pop.diploids)
+    {
+        const double x = boost::geometry::get<0>(dip.v.first), y = boost::geometry::get<1>(dip.v.first);
+        put(&x,sizeof(x));
+        put(&y,sizeof(y));
+    }
+    if(genotypes)
+    {
+        for(const auto & dip : pop.diploids)
+        {
+            for(const auto g : {dip.first,dip.second})
+            {
+                const auto & gam = pop.gametes[g];
+                const std::uint32_t nm = std::uint32_t(gam.mutations.size() + gam.smutations.size());
+                put(&nm,sizeof(nm));
+                for(const auto * c : {&gam.mutations,&gam.smutations})
+                {
+                    for(const auto k : *c)
+                    {
+                        const double pos = pop.mutations[k].pos, s = pop.mutations[k].s;
+                        put(&pos,sizeof(pos));
+                        put(&s,sizeof(s));
+                    }
+                }
+            }
+        }
+    }
+    bool ok = std::fwrite(buffer.data(),1,buffer.size(),f) == buffer.size();
+    ok = (std::fclose(f) == 0) && ok;
+    if(!ok) throw std::runtime_error("error writing " + filename);
+}
+}
+#endif
@@ -0,0 +1,241 @@
+#ifndef LANDSCAPE_LINERULES_HPP
+#define LANDSCAPE_LINERULES_HPP
+
+#include <vector>
+#include <cmath>
+#include <cstdint>
+#include <cassert>
+#include <utility>
+#include <algorithm>
+#include <stdexcept>
+#include <type_traits>
+#include "simtypes.hpp"
+#include "wfrules.hpp"
+
+namespace landscape
+{
+/*
+ * Spatial index for a 1-d landscape, the interval [0,1].
+ *
+ * On a line, an rtree is overkill: the diploids sorted by
+ * position are a perfectly good index.  Everyone within a
+ * distance of a point is a contiguous range of the sorted array,
+ * found by two binary searches, and the k nearest neighbours
+ * are found by walking outwards from a diploid's rank.
+ *
+ * Entries are (x, index in diploids).  insert() just appends,
+ * and sort() must be called before the index is searched.
+ */
+struct line_index
+{
+    using value_type = csdiploid1d::value;
+    using entry = std::pair<double,std::size_t>;
+    std::vector<entry> entries;
+
+    line_index() : entries()
+    {
+    }
+
+    inline void insert(const value_type & v)
+    {
+        entries.emplace_back(boost::geometry::get<0>(v.first),v.second);
+    }
+
+    //Sort by position.  Ties are broken by index, so that
+    //the order does not depend on the order of insertion.
+    inline void sort()
+    {
+        std::sort(entries.begin(),entries.end());
+    }
+
+    inline std::size_t size() const
+    {
+        return entries.size();
+    }
+
+    //The range [first,last) of sorted entries with lo <= x <= hi
+    inline std::pair<std::size_t,std::size_t> window(const double lo, const double hi) const
+    {
+        auto first = std::lower_bound(entries.begin(),entries.end(),lo,[](const entry & e, double x) {
+            return e.first < x;
+        });
+        auto last = std::upper_bound(first,entries.end(),hi,[](double x, const entry & e) {
+            return x < e.first;
+        });
+        return std::make_pair(std::size_t(first-entries.begin()),std::size_t(last-entries.begin()));
+    }
+};
+
+/*
+ * The rules class for a 1-d landscape.  The model is the
+ * same as for 2-d (see wfrules.hpp): parent 1 is picked
+ * from the whole population, parent 2 from within the
+ * mating radius or from the k nearest neighbours,
+ * offspring are at the parents' midpoint + Gaussian dispersal.
+ *
+ * Because possible mates are a contiguous range of the sorted
+ * index, picking parent 2 by fitness is a binary search on
+ * prefix sums of fitness in sorted order.  Thus, a radius
+ * pick costs O(log N), no matter how many diploids are in the
+ * radius, and nothing is copied.
+ *
+ * Possible mates are in order of position rather than birth order,
+ * so results differ from the 2-d rules given the same seed.
+ *
+ * This is the specialization for dimension 1.  The index must be a
+ * line_index, dispersal is Gaussian, and the mating mode is chosen at
+ * run time, but only radius and knn are implemented: w() throws for
+ * the others.
+ */
+template<typename index_type,typename mating_policy,typename dispersal_policy>
+struct WFLandscapeRules<index_type,mating_policy,dispersal_policy,1>
+{
+    static_assert(std::is_same<index_type,line_index>::value,"the 1-d rules need a line_index");
+    static_assert(std::is_same<mating_policy,runtime_mating>::value,"the 1-d rules choose the mating mode at run time");
+    static_assert(std::is_same<dispersal_policy,gaussian_dispersal>::value,"the 1-d rules only have Gaussian dispersal");
+    double wbar,radius,dispersal;
+    std::size_t dipindex;
+    std::vector<double> fitnesses;
+    //See wfrules.hpp
+    std::vector<double> fitness_modifiers;
+    //cumfitness[i] is the sum of fitnesses of the first i sorted parents,
+    //and rank[j] is where diploid j is in the sorted parents.
+    std::vector<double> cumfitness;
+    std::vector<std::size_t> rank;
+    KTfwd::fwdpp_internal::gsl_ran_discrete_t_ptr lookup;
+    line_index parental_index,offspring_index;
+    mating_mode mating;
+    unsigned k;
+    double max_distance;
+    std::uint64_t npicks,nselfs,nforced_selfs;
+
+    WFLandscapeRules(line_index && r,double radius_,double dispersal_) :
+        wbar(0.),radius(radius_),dispersal(dispersal_),dipindex(0),
+        fitnesses(),fitness_modifiers(),cumfitness(),rank(),
+        lookup(KTfwd::fwdpp_internal::gsl_ran_discrete_t_ptr(nullptr)),
+        parental_index(),
+        offspring_index(std::move(r)),
+        mating(mating_mode::radius),k(0),max_distance(0.),
+        npicks(0),nselfs(0),nforced_selfs(0)
+    {
+    }
+
+    template<typename dipcont_t,
+             typename gcont_t,
+             typename mcont_t,
+             typename fitness_func>
+    void w(const dipcont_t & diploids,
+           gcont_t & gametes,
+           const mcont_t & mutations,
+           const fitness_func & ff)
+    {
+        if(mating != mating_mode::radius && mating != mating_mode::knn)
+        {
+            throw std::runtime_error("1-d mating must be radius or knn");
+        }
+        //Swap rather than move, so that the offspring index
+        //keeps its capacity from two generations ago.
+        std::swap(parental_index,offspring_index);
+        offspring_index.entries.clear();
+        parental_index.sort();
+        dipindex=0;
+        const std::size_t N_curr = diploids.size();
+        assert(parental_index.size() == N_curr);
+        fitnesses.resize(N_curr);
+        wbar = 0.;
+        for(std::size_t i = 0 ; i < N_curr ; ++i)
+        {
+            gametes[diploids[i].first].n=gametes[diploids[i].second].n=0;
+            fitnesses[i]=ff(diploids[i],gametes,mutations);
+            if(!fitness_modifiers.empty()) fitnesses[i]*=fitness_modifiers[i];
+            wbar+=fitnesses[i];
+        }
+        wbar /= double(N_curr);
+        cumfitness.resize(N_curr+1);
+        rank.resize(N_curr);
+        cumfitness[0] = 0.;
+        for(std::size_t i = 0 ; i < N_curr ; ++i)
+        {
+            const auto j = parental_index.entries[i].second;
+            assert(diploids[j].v.second == j);
+            rank[j] = i;
+            cumfitness[i+1] = cumfitness[i] + fitnesses[j];
+        }
+        lookup = KTfwd::fwdpp_internal::gsl_ran_discrete_t_ptr(gsl_ran_discrete_preproc(N_curr,&fitnesses[0]));
+    }
+
+    inline size_t pick1(const gsl_rng * r) const
+    {
+        return gsl_ran_discrete(r,lookup.get());
+    }
+
+    template<typename diploid_t,typename gcont_t,typename mcont_t>
+    inline size_t pick2(const gsl_rng * r, const size_t & p1, const double & ,
+                        diploid_t &, const gcont_t &, const mcont_t &)
+    {
+        ++npicks;
+        auto range = (mating == mating_mode::knn) ? knn_window(p1) : radius_window(p1);
+        std::size_t p2 = p1;
+        if(range.second - range.first <= 1) ++nforced_selfs;
+        else p2 = choose_by_fitness(r,range.first,range.second);
+        if(p2==p1) ++nselfs;
+        return p2;
+    }
+
+    //Sorted parents within the mating radius of parent p1, which includes p1
+    inline std::pair<std::size_t,std::size_t> radius_window(const std::size_t p1) const
+    {
+        const double x = parental_index.entries[rank[p1]].first;
+        return parental_index.window(x-radius,x+radius);
+    }
+
+    //p1 and its k nearest neighbours, optionally only those within
+    //max_distance.  Walk outwards from p1, taking the closer of the two
+    //neighbours each step.  Ties go to the left.
+    inline std::pair<std::size_t,std::size_t> knn_window(const std::size_t p1) const
+    {
+        const auto & e = parental_index.entries;
+        const double x = e[rank[p1]].first;
+        const double dmax = (max_distance > 0.) ? max_distance : HUGE_VAL;
+        std::size_t lo = rank[p1], hi = rank[p1]+1;
+        for(unsigned n = 0 ; n < k ; ++n)
+        {
+            const double dl = (lo > 0) ? x - e[lo-1].first : HUGE_VAL;
+            const double dr = (hi < e.size()) ? e[hi].first - x : HUGE_VAL;
+            if(std::min(dl,dr) > dmax) break;
+            if(dl <= dr) --lo;
+            else ++hi;
+        }
+        return std::make_pair(lo,hi);
+    }
+
+    //Pick from sorted parents [first,last) proportional to fitness.
+    //Find the u-th unit of fitness in the range by binary search on
+    //the prefix sums.
+    inline size_t choose_by_fitness(const gsl_rng * r, const std::size_t first, const std::size_t last) const
+    {
+        const double sumw = cumfitness[last]-cumfitness[first];
+        if(!(sumw > 0.)) return parental_index.entries[last-1].second;
+        const double target = cumfitness[first] + gsl_ran_flat(r,0.0,sumw);
+        auto i = std::size_t(std::upper_bound(cumfitness.begin()+first+1,cumfitness.begin()+last+1,target)
+                             - cumfitness.begin()) - 1;
+        //Rounding in the prefix sums may put target at the very end
+        if(i >= last) i = last-1;
+        return parental_index.entries[i].second;
+    }
+
+    template<typename diploid_t,typename gcont_t,typename mcont_t>
+    void update(const gsl_rng * r, diploid_t & offspring,const diploid_t & parent1,
+                const diploid_t & parent2,
+                const gcont_t &,
+                const mcont_t &)
+    {
+        double x = (boost::geometry::get<0>(parent1.v.first)+boost::geometry::get<0>(parent2.v.first))/2.0 + gsl_ran_gaussian(r,dispersal);
+        if (x<0.)x=0.;
+        if (x>1.)x=1.;
+        offspring.v = typename diploid_t::value(std::make_pair(typename diploid_t::point(x),dipindex++));
+        offspring_index.insert(offspring.v);
+    }
+};
+}
+#endif
@@ -0,0 +1,65 @@
+/*
+ * Writes an initial landscape file, for use with initial=file:filename
+ * (see initial.hpp).  The coordinates come from one of the generators,
+ * or from a text file of x y pairs, e.g. empirical sampling locations
+ * rescaled to [0,1]^2.
+ */
+#include "simtypes.hpp"
+#include "initial.hpp"
+#include <cassert> //fwdpp has this missing in one of its headers...
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <fwdpp/sugar/GSLrng_t.hpp>
+
+int main(int argc, char ** argv)
+{
+    if(argc<5)
+    {
+        std::cerr << "Incorrect number of arguments.\n"
+                  << "Usage:\n"
+                  << argv[0] << ' '
+                  << "N "
+                  << "seed "
+                  << "spec "
+                  << "outfile\n"
+                  << "\n"
+                  << "spec is an initial landscape (see initial.hpp), or text:filename, where\n"
+                  << "filename has one x y pair per line.  For text:, N is ignored.\n";
+        exit(0);
+    }
+    unsigned N = atoi(argv[1]);
+    const unsigned seed = atoi(argv[2]);
+    const std::string spec(argv[3]), outfile(argv[4]);
+
+    KTfwd::GSLrng_t<KTfwd::GSL_RNG_MT19937> rng(seed);
+    try
+    {
+        std::vector<landscape::csdiploid::value> values;
+        if(spec.compare(0,5,"text:") == 0)
+        {
+            std::ifstream in(spec.substr(5));
+            if(!in) throw std::runtime_error("could not open " + spec.substr(5));
+            double x,y;
+            while(in >> x >> y)
+            {
+                if(x < 0. || x > 1. || y < 0. || y > 1.)
+                {
+                    throw std::runtime_error("coordinates must be in [0,1]");
+                }
+                values.emplace_back(landscape::csdiploid::point(x,y),values.size());
+            }
+            if(!in.eof()) throw std::runtime_error("could not parse " + spec.substr(5));
+            N = unsigned(values.size());
+        }
+        landscape::poptype pop(N);
+        if(values.empty()) landscape::initial_landscape(spec,rng.get(),pop,values);
+        else for(std::size_t i = 0 ; i < N ; ++i) pop.diploids[i].v = values[i];
+        landscape::write_initial_landscape(outfile,pop,false);
+    }
+    catch(std::exception & e)
+    {
+        std::cerr << "Error: " << e.what() << '\n';
+        exit(1);
+    }
+}
@@ -0,0 +1,278 @@
+#ifndef LANDSCAPE_MEMORY_HPP
+#define LANDSCAPE_MEMORY_HPP
+
+#include <new>
+#include <limits>
+#include <vector>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <utility>
+#include <algorithm>
+#include <type_traits>
+
+namespace landscape
+{
+/*
+ * Memory accounting and compaction for long runs.
+ *
+ * memory_usage() adds up the bytes held by each container of a population,
+ * plus those held by a spatial index that uses counting_allocator.
+ *
+ * Over many generations, the gametes and mutations containers
+ * fill up with slots that fwdpp keeps for recycling: gametes
+ * with a count of 0 and mutations that are lost.  compact() copies
+ * the live ones into dense storage, in the order diploids refer to them,
+ * and renumbers the gametes of diploids and the mutations of gametes.
+ * Mutation positions, and hence mut_lookup, are not affected.
+ * compaction_schedule decides when that is worthwhile.
+ */
+
+//Bytes currently allocated by counting_allocators with the given tag.
+//This is shared by all threads.
+template<typename tag>
+inline std::atomic<std::int64_t> & allocated_bytes()
+{
+    static std::atomic<std::int64_t> bytes(0);
+    return bytes;
+}
+
+//The tag for spatial indexes
+struct index_memory
+{
+};
+
+//std::allocator that keeps track of allocated_bytes<tag>(),
+//e.g. for the nodes of an rtree, which is its 5th template parameter.
+template<typename T,typename tag = index_memory>
+struct counting_allocator
+{
+    using value_type = T;
+    using pointer = T *;
+    using const_pointer = const T *;
+    using reference = T &;
+    using const_reference = const T &;
+    using size_type = std::size_t;
+    using difference_type = std::ptrdiff_t;
+    template<typename U>
+    struct rebind
+    {
+        using other = counting_allocator<U,tag>;
+    };
+
+    counting_allocator() noexcept
+    {
+    }
+    template<typename U>
+    counting_allocator(const counting_allocator<U,tag> &) noexcept
+    {
+    }
+
+    pointer allocate(const size_type n, const void * = nullptr)
+    {
+        allocated_bytes<tag>().fetch_add(std::int64_t(n*sizeof(T)),std::memory_order_relaxed);
+        return static_cast<pointer>(::operator new(n*sizeof(T)));
+    }
+    void deallocate(pointer p, const size_type n) noexcept
+    {
+        allocated_bytes<tag>().fetch_sub(std::int64_t(n*sizeof(T)),std::memory_order_relaxed);
+        ::operator delete(p);
+    }
+    size_type max_size() const noexcept
+    {
+        return std::numeric_limits<size_type>::max()/sizeof(T);
+    }
+    template<typename U,typename... args>
+    void construct(U * p, args &&... a)
+    {
+        ::new(static_cast<void *>(p)) U(std::forward<args>(a)...);
+    }
+    template<typename U>
+    void destroy(U * p)
+    {
+        p->~U();
+    }
+};
+
+template<typename T,typename U,typename tag>
+inline bool operator==(const counting_allocator<T,tag> &, const counting_allocator<U,tag> &) noexcept
+{
+    return true;
+}
+
+template<typename T,typename U,typename tag>
+inline bool operator!=(const counting_allocator<T,tag> &, const counting_allocator<U,tag> &) noexcept
+{
+    return false;
+}
+
+//Bytes held by each container.  Those of mut_lookup are an estimate,
+//as the standard library does not say how big its nodes are.
+//index is -1 if not known.
+struct memory_report
+{
+    std::size_t diploids,gametes,gamete_keys,mutations,mcounts,mut_lookup,fixations;
+    std::int64_t index;
+    //# of gametes with non-zero counts and # of mutations they carry
+    std::size_t live_gametes,live_mutations,ngametes,nmutations;
+
+    std::size_t total() const
+    {
+        return diploids + gametes + gamete_keys + mutations + mcounts + mut_lookup + fixations
+               + std::size_t(std::max(std::int64_t(0),index));
+    }
+};
+
+template<typename poptype>
+memory_report memory_usage(const poptype & pop, const std::int64_t index_bytes = -1)
+{
+    memory_report m;
+    m.diploids = pop.diploids.capacity()*sizeof(typename poptype::diploid_t);
+    m.gametes = pop.gametes.capacity()*sizeof(typename poptype::gcont_t::value_type);
+    m.gamete_keys = 0;
+    m.live_gametes = 0;
+    for(const auto & g : pop.gametes)
+    {
+        m.gamete_keys += (g.mutations.capacity() + g.smutations.capacity())*sizeof(typename decltype(g.mutations)::value_type);
+        if(g.n) ++m.live_gametes;
+    }
+    m.mutations = pop.mutations.capacity()*sizeof(typename poptype::mcont_t::value_type);
+    m.mcounts = pop.mcounts.capacity()*sizeof(typename decltype(pop.mcounts)::value_type);
+    //buckets, plus nodes holding a value, a next pointer and a hash
+    m.mut_lookup = pop.mut_lookup.bucket_count()*sizeof(void *)
+                   + pop.mut_lookup.size()*(sizeof(typename decltype(pop.mut_lookup)::value_type) + sizeof(void *) + sizeof(std::size_t));
+    m.fixations = pop.fixations.capacity()*sizeof(typename decltype(pop.fixations)::value_type)
+                  + pop.fixation_times.capacity()*sizeof(typename decltype(pop.fixation_times)::value_type);
+    m.index = index_bytes;
+    m.live_mutations = std::size_t(std::count_if(pop.mcounts.begin(),pop.mcounts.end(),[](unsigned c) {
+        return c > 0;
+    }));
+    m.ngametes = pop.gametes.size();
+    m.nmutations = pop.mutations.size();
+    return m;
+}
+
+//One line of the run log
+inline std::ostream & operator<<(std::ostream & o, const memory_report & m)
+{
+    o << "total = " << m.total()
+      << ", diploids = " << m.diploids
+      << ", gametes = " << m.gametes << " + " << m.gamete_keys << " in keys"
+      << " (" << m.live_gametes << " of " << m.ngametes << " live)"
+      << ", mutations = " << m.mutations << " + " << m.mcounts << " in counts"
+      << " (" << m.live_mutations << " of " << m.nmutations << " live)"
+      << ", mut_lookup = " << m.mut_lookup
+      << ", fixations = " << m.fixations
+      << ", index = ";
+    if(m.index >= 0) o << m.index;
+    else o << "NA";
+    return o;
+}
+
+//Sizes before and after a call to compact
+struct compaction_stats
+{
+    std::size_t gametes_before,gametes_after,mutations_before,mutations_after;
+};
+
+/* Renumber the gametes and mutations of pop densely.  Gametes
+ * are kept if a diploid has them, in the order of diploids.
+ * Mutations are kept if one of those gametes has them, in the order of the
+ * gametes, so a gamete's keys stay sorted by position.
+ * mcounts moves along with the mutations.
+ * Must be called between generations, when no one else refers
+ * to gametes or mutations by index.
+ */
+template<typename poptype>
+compaction_stats compact(poptype & pop)
+{
+    compaction_stats stats;
+    stats.gametes_before = pop.gametes.size();
+    stats.mutations_before = pop.mutations.size();
+    const std::size_t none = std::numeric_limits<std::size_t>::max();
+
+    std::vector<std::size_t> gamete_map(pop.gametes.size(),none);
+    typename poptype::gcont_t gametes;
+    gametes.reserve(std::min(pop.gametes.size(),2*pop.diploids.size()));
+    auto move_gamete = [&](std::size_t & g) {
+        if(gamete_map[g] == none)
+        {
+            gamete_map[g] = gametes.size();
+            gametes.push_back(std::move(pop.gametes[g]));
+        }
+        g = gamete_map[g];
+    };
+    for(auto & dip : pop.diploids)
+    {
+        move_gamete(dip.first);
+        move_gamete(dip.second);
+    }
+
+    std::vector<std::size_t> mutation_map(pop.mutations.size(),none);
+    typename poptype::mcont_t mutations;
+    std::vector<typename decltype(pop.mcounts)::value_type> mcounts;
+    auto renumber = [&](typename decltype(gametes.front().mutations)::value_type & k) {
+        if(mutation_map[k] == none)
+        {
+            mutation_map[k] = mutations.size();
+            mutations.push_back(pop.mutations[k]);
+            mcounts.push_back(pop.mcounts[k]);
+        }
+        k = typename std::remove_reference<decltype(k)>::type(mutation_map[k]);
+    };
+    for(auto & g : gametes)
+    {
+        for(auto & k : g.mutations) renumber(k);
+        for(auto & k : g.smutations) renumber(k);
+    }
+    pop.gametes.swap(gametes);
+    pop.mutations.swap(mutations);
+    pop.mcounts.swap(mcounts);
+    pop.mut_lookup.rehash(0);
+
+    stats.gametes_after = pop.gametes.size();
+    stats.mutations_after = pop.mutations.size();
+    return stats;
+}
+
+/* When to compact.  check() looks at the fraction of gametes and
+ * mutations that are dead, which is cheap next to a generation, so it
+ * may be called every generation.  It compacts if either fraction is above
+ * max_dead, but not within "interval" generations of the last compaction.
+ * Some of the dead slots are just the churn of each generation.  So, if the
+ * fractions are above max_dead again as soon as compaction is allowed,
+ * interval is doubled, up to max_interval.  If it took longer, it is halved.
+ */
+class compaction_schedule
+{
+    double max_dead;
+    unsigned interval,max_interval,next;
+public:
+    std::size_t ncompactions;
+    explicit compaction_schedule(const double max_dead_ = 0.5, const unsigned max_interval_ = 1024) :
+        max_dead(max_dead_),interval(1),max_interval(std::max(1u,max_interval_)),next(0),ncompactions(0)
+    {
+    }
+
+    template<typename poptype>
+    bool check(poptype & pop, const unsigned generation, compaction_stats * stats = nullptr)
+    {
+        if(generation < next) return false;
+        std::size_t live_gametes = 0, live_mutations = 0;
+        for(const auto & g : pop.gametes) if(g.n) ++live_gametes;
+        for(auto c : pop.mcounts) if(c) ++live_mutations;
+        const bool due = double(pop.gametes.size() - live_gametes) > max_dead*double(pop.gametes.size()) ||
+                         double(pop.mutations.size() - live_mutations) > max_dead*double(pop.mutations.size());
+        if(!due) return false;
+        if(ncompactions && generation == next) interval = std::min(max_interval,2*interval);
+        else interval = std::max(1u,interval/2);
+        next = generation + interval;
+        auto s = compact(pop);
+        if(stats) *stats = s;
+        ++ncompactions;
+        return true;
+    }
+};
+}
+#endif
@@ -0,0 +1,142 @@
+#ifndef LANDSCAPE_MODELS_HPP
+#define LANDSCAPE_MODELS_HPP
+
+#include <vector>
+#include <algorithm>
+#include <fwdpp/diploid.hh>
+#include <fwdpp/sugar/popgenmut.hpp>
+#include <fwdpp/sugar/infsites.hpp>
+#include <gsl/gsl_rng.h>
+#include "simtypes.hpp"
+
+namespace landscape
+{
+//Sign of s at a point.  In 2-d, s is treated as -s in the
+//lower left quadrant of the landscape.  In 1-d, it is the left half.
+inline double geographic_factor(const csdiploid::point & p)
+{
+    return (boost::geometry::get<0>(p) <= 0.5 && boost::geometry::get<1>(p) <= 0.5) ? -1.0 : 1.0;
+}
+
+inline double geographic_factor(const csdiploid1d::point & p)
+{
+    return (boost::geometry::get<0>(p) <= 0.5) ? -1.0 : 1.0;
+}
+
+/* The models below are plain function objects, rather than
+ * std::bind expressions, so that their types are known to the
+ * compiler where fwdpp calls them, once per diploid, gamete or mutation,
+ * and they can be inlined.  wflandscape_timing can be built
+ * with the std::bind versions for comparison (see the Makefile).
+ */
+
+//Geography policies give the sign of s at a point.
+//s is treated as -s in the lower left quadrant (left half in 1-d)
+struct quadrant_geography
+{
+    template<typename point_t>
+    static inline double factor(const point_t & p)
+    {
+        return geographic_factor(p);
+    }
+};
+
+//s is the same everywhere
+struct uniform_geography
+{
+    template<typename point_t>
+    static inline double factor(const point_t &)
+    {
+        return 1.0;
+    }
+};
+
+//Arbitrary model for fitness.
+//Treat s as -s where the geography
+//policy says so, otherwise as s.
+//Fitness is multiplicative across sites.
+template<typename geography_policy>
+struct spatial_fitness_t
+{
+    /* This function makes a spatial fitness object
+     * behave as a function.
+     * Note: if we had an additional landscape that reflected
+     * how the landscape modified genetic values of fitness,
+     * it would be another policy here.
+     * The containers are templates so that they may use any allocator,
+     * e.g. those of placed_poptype (placement.hpp).
+     */
+    template<std::size_t dim,typename gcont_t,typename mcont_t>
+    inline double operator()(const csdiploid_t<dim> & dip,
+                             const gcont_t & gametes,
+                             const mcont_t & mutations) const
+    {
+        KTfwd::site_dependent_fitness s;
+        const double gf = geography_policy::factor(dip.v.first);
+
+        return std::max(0.0,
+                        s(dip,gametes,mutations,
+        [gf](double & w,const KTfwd::popgenmut & m) {
+            w *= (1.0 + gf*2.0*m.s);
+        },
+        [gf](double & w,const KTfwd::popgenmut & m) {
+            w *= (1.0 + gf*m.h*m.s);
+        },
+        1.0));
+    }
+};
+
+using spatial_fitness = spatial_fitness_t<quadrant_geography>;
+
+//Poisson # of crossovers per meiosis, with
+//breakpoints uniform on the 1/2-open interval [0,1)
+struct poisson_recombination
+{
+    const gsl_rng * r;
+    double littler;
+    poisson_recombination(const gsl_rng * r_, const double littler_) : r(r_),littler(littler_)
+    {
+    }
+    template<typename gamete_t,typename mcont_t>
+    inline std::vector<double> operator()(const gamete_t & g1, const gamete_t & g2, const mcont_t & mutations) const
+    {
+        return KTfwd::poisson_xover()(r,littler,0.,1.,g1,g2,mutations);
+    }
+};
+
+//Infinitely-many sites, with positions uniform on (0,1]
+//and the same s and h for every selected mutation.
+//generation is a pointer, so that the origin time of each
+//mutation is recorded.
+template<typename lookup_t>
+struct infsites_mutation
+{
+    const gsl_rng * r;
+    lookup_t & lookup;
+    const unsigned * generation;
+    double mu_n,mu_s,s,h;
+    infsites_mutation(const gsl_rng * r_, lookup_t & lookup_, const unsigned * generation_,
+                      const double mu_n_, const double mu_s_, const double s_, const double h_) :
+        r(r_),lookup(lookup_),generation(generation_),mu_n(mu_n_),mu_s(mu_s_),s(s_),h(h_)
+    {
+    }
+    template<typename queue_t,typename mcont_t>
+    inline std::size_t operator()(queue_t & recycling_bin, mcont_t & mutations) const
+    {
+        const gsl_rng * rr = r;
+        const double sv = s, hv = h;
+        return KTfwd::infsites()(recycling_bin,mutations,r,lookup,generation,mu_n,mu_s,
+                                 [rr] { return gsl_rng_uniform(rr); },
+                                 [sv] { return sv; },
+                                 [hv] { return hv; });
+    }
+};
+
+template<typename lookup_t>
+inline infsites_mutation<lookup_t> make_infsites_mutation(const gsl_rng * r, lookup_t & lookup, const unsigned * generation,
+        const double mu_n, const double mu_s, const double s, const double h)
+{
+    return infsites_mutation<lookup_t>(r,lookup,generation,mu_n,mu_s,s,h);
+}
+}
+#endif
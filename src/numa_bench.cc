@@ -0,0 +1,167 @@
+/*
+ * Measures the effect of memory placement (placement.hpp) on the
+ * memory access of a generation, for large N.
+ *
+ * The diploids are in a vector using placed_allocator, as in placed_poptype,
+ * and the fitnesses are a std::vector passed to place(), as in
+ * WFLandscapeRules::w.  Both are filled by the main thread first, which
+ * is what happens in a simulation.  Then, for each placement, the operations
+ * timed are:
+ * fill: the main thread writes every fitness and diploid.
+ * sweep: each of the threads reads a contiguous 1/threads of the fitnesses and
+ *        diploids, as w() does.
+ * gather: each thread reads the fitness and coordinates of randomly-chosen
+ *         diploids, as pick1 and pick2 do.
+ *
+ * Output is CSV:
+ * numa,huge_pages,threads,N,operation,seconds,ns_per_access,anon_huge_kB,mbind_failures
+ * where anon_huge_kB is the process's memory on transparent huge pages, from
+ * /proc/self/smaps_rollup, or -1 if that is not available.
+ */
+#include "simtypes.hpp"
+#include "placement.hpp"
+#include "options.hpp"
+#include <cassert> //fwdpp has this missing in one of its headers...
+#include <cstdlib>
+#include <cstdint>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <thread>
+#include <fstream>
+#include <iostream>
+
+using diploid_vector = std::vector<landscape::csdiploid,landscape::placed_allocator<landscape::csdiploid>>;
+
+long anon_huge_kb()
+{
+    std::ifstream in("/proc/self/smaps_rollup");
+    std::string name;
+    long kb;
+    while(in >> name)
+    {
+        if(name == "AnonHugePages:" && in >> kb) return kb;
+    }
+    return -1;
+}
+
+//Runs f(t) on threads t = 0 to nthreads-1 and returns the time taken
+template<typename F>
+double run_threads(const unsigned nthreads, F f)
+{
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> workers;
+    for(unsigned t = 1 ; t < nthreads ; ++t) workers.emplace_back(f,t);
+    f(0u);
+    for(auto & w : workers) w.join();
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count();
+}
+
+int main(int argc, char ** argv)
+{
+    if(argc > 1 && std::string(argv[1]).find('=') == std::string::npos)
+    {
+        std::cerr << "Usage:\n"
+                  << argv[0] << " [name=value ...]\n"
+                  << "\n"
+                  << "Optional arguments:\n"
+                  << "N = # diploids (default 10000000)\n"
+                  << "threads = # threads (default: # cores)\n"
+                  << "gathers = # random reads per thread (default 10000000)\n"
+                  << "numa = comma-separated list of none,interleave,partitioned (default all)\n"
+                  << "huge_pages = comma-separated list of none,transparent,explicit (default all)\n"
+                  << "seed = random number seed (default 42)\n"
+                  << "\n"
+                  << "Output is CSV on stdout.  See numa_bench.cc for the columns.\n";
+        exit(0);
+    }
+    landscape::options opts(argc,argv,1);
+    const std::size_t N = std::size_t(opts.get("N",1e7));
+    const unsigned nthreads = std::max(1u,opts.get("threads",std::thread::hardware_concurrency()));
+    const std::size_t ngathers = std::size_t(opts.get("gathers",1e7));
+    const std::string numa_list = opts.get("numa","none,interleave,partitioned");
+    const std::string pages_list = opts.get("huge_pages","none,transparent,explicit");
+    const std::uint64_t seed = opts.get("seed",42u);
+    opts.check();
+
+    auto split = [](const std::string & s) {
+        std::vector<std::string> rv;
+        std::istringstream in(s);
+        std::string item;
+        while(std::getline(in,item,',')) if(!item.empty()) rv.push_back(item);
+        return rv;
+    };
+
+    std::cout << "numa,huge_pages,threads,N,operation,seconds,ns_per_access,anon_huge_kB,mbind_failures\n";
+    for(const auto & numa : split(numa_list))
+    {
+        for(const auto & pages : split(pages_list))
+        {
+            landscape::placement_config config;
+            if(!landscape::parse_placement(numa,pages,config))
+            {
+                std::cerr << "Error: bad placement " << numa << ' ' << pages << '\n';
+                exit(1);
+            }
+            config.nparts = nthreads;
+            landscape::memory_placement() = config;
+            const auto failures = landscape::placement_stats().mbind_failures.load();
+            auto report = [&](const char * operation, const double s, const std::size_t accesses) {
+                std::cout << numa << ',' << pages << ',' << nthreads << ',' << N << ',' << operation << ','
+                          << s << ',' << 1e9*s/double(accesses) << ',' << anon_huge_kb() << ','
+                          << landscape::placement_stats().mbind_failures.load() - failures << '\n';
+            };
+            double checksum = 0.;
+            {
+                auto start = std::chrono::steady_clock::now();
+                diploid_vector diploids(N);
+                //Placed before the pages are first written, as in WFLandscapeRules::w
+                std::vector<double> fitnesses;
+                fitnesses.reserve(N);
+                landscape::place(fitnesses.data(),fitnesses.capacity()*sizeof(double));
+                fitnesses.resize(N);
+                for(std::size_t i = 0 ; i < N ; ++i)
+                {
+                    const double x = double(i)/double(N);
+                    diploids[i].first = diploids[i].second = i;
+                    diploids[i].v = landscape::csdiploid::value(landscape::csdiploid::point(x,1.-x),i);
+                    fitnesses[i] = 1. + 1e-3*x;
+                }
+                std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+                report("fill",elapsed.count(),N);
+
+                std::vector<double> sums(nthreads,0.);
+                double s = run_threads(nthreads,[&](const unsigned t) {
+                    const std::size_t first = N*t/nthreads, last = N*(t+1)/nthreads;
+                    double sum = 0.;
+                    for(std::size_t i = first ; i < last ; ++i)
+                    {
+                        sum += fitnesses[i]*boost::geometry::get<0>(diploids[i].v.first);
+                    }
+                    sums[t] = sum;
+                });
+                report("sweep",s,N);
+                for(auto x : sums) checksum += x;
+
+                s = run_threads(nthreads,[&](const unsigned t) {
+                    //xorshift64*, which is much cheaper than the memory access being timed
+                    std::uint64_t state = seed*0x9E3779B97F4A7C15ull + t + 1;
+                    double sum = 0.;
+                    for(std::size_t j = 0 ; j < ngathers ; ++j)
+                    {
+                        state ^= state >> 12;
+                        state ^= state << 25;
+                        state ^= state >> 27;
+                        const std::size_t i = std::size_t((state*0x2545F4914F6CDD1Dull) >> 11) % N;
+                        sum += fitnesses[i]*boost::geometry::get<1>(diploids[i].v.first);
+                    }
+                    sums[t] = sum;
+                });
+                report("gather",s,ngathers*nthreads);
+                for(auto x : sums) checksum += x;
+            }
+            if(checksum == 0.) std::cerr << "checksum is 0\n";
+        }
+    }
+}
@@ -0,0 +1,318 @@
+#ifndef LANDSCAPE_OGENGINE_HPP
+#define LANDSCAPE_OGENGINE_HPP
+
+#include <vector>
+#include <queue>
+#include <cmath>
+#include <limits>
+#include <algorithm>
+#include <cstdint>
+#include <gsl/gsl_rng.h>
+#include <gsl/gsl_randist.h>
+#include <fwdpp/diploid.hh>
+#include <boost/geometry.hpp>
+#include <boost/geometry/index/rtree.hpp>
+#include "fitness_sampler.hpp"
+
+namespace landscape
+{
+/*
+ * Overlapping generations in continuous time.
+ *
+ * Unlike WFLandscapeRules, which throws away the rtree each
+ * generation, this engine keeps one rtree of the living diploids
+ * and updates it one event at a time:
+ *
+ * Birth: parent 1 is chosen from all living diploids proportional
+ * to fitness.  Parent 2 is chosen within "radius" of parent 1,
+ * exactly as in WFLandscapeRules::pick2.  The offspring is placed
+ * at the parental midpoint + Gaussian dispersal, is inserted
+ * into the rtree, and takes a free slot in pop.diploids.
+ *
+ * Death: a living diploid is chosen uniformly, removed from
+ * the rtree, and its slot in pop.diploids goes on a free list.
+ *
+ * Each diploid gives birth at rate w (its fitness), and dies at
+ * rate n/K, where n is the # living diploids.  Thus, the population
+ * is regulated around the "carrying capacity" K, and time is measured
+ * in units of expected lifetimes.
+ *
+ * Fitnesses live in a fitness_sampler, so both parent
+ * choice and fitness updates are O(log N).
+ *
+ * Mutation and recombination use fwdpp's machinery, with
+ * gamete and mutation recycling.  Gametes are recycled as soon
+ * as their count drops to 0.  Mutation counts, fixations, and
+ * the mutation recycling bin are updated by bookkeeping(),
+ * which the calling environment should call once per unit time.
+ *
+ * The template type must be something with the API of a
+ * boost::geometry::rtree.
+ */
+template<typename rtree_type>
+class OGLandscapeEngine
+{
+public:
+    using value_t = typename rtree_type::value_type;
+    static constexpr std::size_t npos = std::numeric_limits<std::size_t>::max();
+    double time,radius,dispersal,K;
+    std::uint64_t nbirths,ndeaths;
+    fitness_sampler fitnesses;
+    rtree_type rtree;
+    //Slots in pop.diploids holding living diploids.
+    //where[i] is the position of slot i in living, or npos.
+    std::vector<std::size_t> living,where,free_slots;
+    std::queue<std::size_t> gamete_recycling_bin,mutation_recycling_bin;
+
+    //The rtree must contain all diploids in the population,
+    //and gets moved in.
+    OGLandscapeEngine(rtree_type && r, double radius_, double dispersal_, double K_) :
+        time(0.),radius(radius_),dispersal(dispersal_),K(K_),nbirths(0),ndeaths(0),
+        fitnesses(),rtree(std::move(r)),living(),where(),free_slots(),
+        gamete_recycling_bin(),mutation_recycling_bin(),possible_mates(),
+        next_bookkeeping(1.)
+    {
+    }
+
+    //Call once before the first event.  Calculates fitnesses
+    //and sets up the recycling bins.
+    template<typename poptype, typename fitness_func>
+    void init(poptype & pop, const fitness_func & ff)
+    {
+        living.resize(pop.diploids.size());
+        where.resize(pop.diploids.size());
+        fitnesses.resize(pop.diploids.size());
+        for(std::size_t i = 0 ; i < pop.diploids.size() ; ++i)
+        {
+            living[i] = where[i] = i;
+            fitnesses.set(i,ff(pop.diploids[i],pop.gametes,pop.mutations));
+        }
+        fitnesses.rebuild();
+        for(std::size_t i = 0 ; i < pop.gametes.size() ; ++i)
+        {
+            if(!pop.gametes[i].n) gamete_recycling_bin.push(i);
+        }
+        KTfwd::fwdpp_internal::process_gametes(pop.gametes,pop.mutations,pop.mcounts);
+        rebuild_mutation_recycling_bin(pop.mcounts);
+    }
+
+    //Living population size
+    std::size_t size() const
+    {
+        return living.size();
+    }
+
+    /* Apply one birth or death event.
+     * mu is the total mutation rate per gamete per birth.
+     * Returns false if the population is extinct.
+     */
+    template<typename poptype, typename mutation_model,
+             typename recombination_policy, typename fitness_func>
+    bool event(const gsl_rng * r, poptype & pop, const double mu,
+               const mutation_model & mmodel,
+               const recombination_policy & rec_pol,
+               const fitness_func & ff)
+    {
+        if(living.empty()) return false;
+        const double n = double(living.size());
+        const double B = fitnesses.total();
+        const double D = n*n/K;
+        time += gsl_ran_exponential(r,1.0/(B+D));
+        if(gsl_rng_uniform(r)*(B+D) < B) birth(r,pop,mu,mmodel,rec_pol,ff);
+        else death(r,pop);
+        return true;
+    }
+
+    /* Update mutation counts, and remove fixations.
+     * This has the same cost as the end of a W-F generation,
+     * so should be called about once per unit time, i.e.
+     * once every ~2K events.
+     */
+    template<typename poptype>
+    void bookkeeping(poptype & pop, const unsigned generation)
+    {
+        KTfwd::fwdpp_internal::process_gametes(pop.gametes,pop.mutations,pop.mcounts);
+        const unsigned twoN = unsigned(2*living.size());
+        if(twoN && std::find(pop.mcounts.begin(),pop.mcounts.end(),twoN) != pop.mcounts.end())
+        {
+            auto fixed = [&pop,twoN](const std::size_t k) {
+                return pop.mcounts[k]==twoN;
+            };
+            for(auto & g : pop.gametes)
+            {
+                if(!g.n) continue;
+                g.mutations.erase(std::remove_if(g.mutations.begin(),g.mutations.end(),fixed),g.mutations.end());
+                g.smutations.erase(std::remove_if(g.smutations.begin(),g.smutations.end(),fixed),g.smutations.end());
+            }
+        }
+        KTfwd::update_mutations(pop.mutations,pop.fixations,pop.fixation_times,pop.mut_lookup,pop.mcounts,generation,twoN);
+        rebuild_mutation_recycling_bin(pop.mcounts);
+        //Discard rounding error accumulated by single-weight updates
+        fitnesses.rebuild();
+    }
+
+    /* Run events until time t, calling bookkeeping() each
+     * time an integer time is passed. generation is the variable
+     * bound to the mutation model for recording origin times.
+     */
+    template<typename poptype, typename mutation_model,
+             typename recombination_policy, typename fitness_func>
+    void run(const gsl_rng * r, poptype & pop, const double t, unsigned & generation,
+             const double mu, const mutation_model & mmodel,
+             const recombination_policy & rec_pol, const fitness_func & ff)
+    {
+        while(time < t)
+        {
+            if(!event(r,pop,mu,mmodel,rec_pol,ff)) return;
+            if(time >= next_bookkeeping)
+            {
+                generation = unsigned(time);
+                bookkeeping(pop,generation);
+                next_bookkeeping = std::floor(time) + 1.;
+            }
+        }
+    }
+
+private:
+    std::vector<value_t> possible_mates;
+    double next_bookkeeping;
+
+    void rebuild_mutation_recycling_bin(const std::vector<unsigned> & mcounts)
+    {
+        mutation_recycling_bin = std::queue<std::size_t>();
+        for(std::size_t i = 0 ; i < mcounts.size() ; ++i)
+        {
+            if(!mcounts[i]) mutation_recycling_bin.push(i);
+        }
+    }
+
+    template<typename gcont_t>
+    void decrement(gcont_t & gametes, const std::size_t g)
+    {
+        assert(gametes[g].n);
+        if(!--gametes[g].n) gamete_recycling_bin.push(g);
+    }
+
+    //Same as WFLandscapeRules::pick2, but over the living diploids.
+    template<typename diploid_t>
+    std::size_t pick2(const gsl_rng * r, const std::size_t p1, const diploid_t & parent1)
+    {
+        namespace bg = boost::geometry;
+        namespace bgi = boost::geometry::index;
+        using point_t = typename diploid_t::point;
+        const double x = bg::get<0>(parent1.v.first), y = bg::get<1>(parent1.v.first);
+        bg::model::box<point_t> region(point_t(x-radius,y-radius),point_t(x+radius,y+radius));
+        possible_mates.clear();
+        rtree.query(bgi::intersects(region) && bgi::satisfies([x,y,this](const value_t & v) {
+            double dx = x - bg::get<0>(v.first), dy = y - bg::get<1>(v.first);
+            return std::sqrt(dx*dx+dy*dy) <= radius;
+        }),
+        std::back_inserter(possible_mates));
+        if(possible_mates.size()==1) return p1;
+        //The order of the query results depends on how the rtree
+        //was built, so put them in slot order.
+        std::sort(possible_mates.begin(),possible_mates.end(),[](const value_t & a, const value_t & b) {
+            return a.second < b.second;
+        });
+        double sumw = 0.0;
+        for(const auto & v : possible_mates) sumw += fitnesses.weight(v.second);
+        double uni = gsl_ran_flat(r,0.0,sumw);
+        double sum = 0.0;
+        for(const auto & v : possible_mates)
+        {
+            sum += fitnesses.weight(v.second);
+            if(uni < sum) return v.second;
+        }
+        return possible_mates.back().second;
+    }
+
+    template<typename poptype, typename mutation_model,
+             typename recombination_policy, typename fitness_func>
+    void birth(const gsl_rng * r, poptype & pop, const double mu,
+               const mutation_model & mmodel,
+               const recombination_policy & rec_pol,
+               const fitness_func & ff)
+    {
+        using diploid_t = typename poptype::diploid_t;
+        const std::size_t p1 = fitnesses.sample(r);
+        const std::size_t p2 = pick2(r,p1,pop.diploids[p1]);
+        //Copy the parents: pop.diploids may be reallocated below
+        const diploid_t parent1(pop.diploids[p1]), parent2(pop.diploids[p2]);
+
+        auto p1g1 = parent1.first, p1g2 = parent1.second;
+        auto p2g1 = parent2.first, p2g2 = parent2.second;
+        if(gsl_rng_uniform(r) < 0.5) std::swap(p1g1,p1g2);
+        if(gsl_rng_uniform(r) < 0.5) std::swap(p2g1,p2g2);
+
+        diploid_t offspring(parent1);
+        offspring.first = KTfwd::recombination(pop.gametes,gamete_recycling_bin,pop.neutral,pop.selected,
+                                               rec_pol,p1g1,p1g2,pop.mutations).first;
+        offspring.second = KTfwd::recombination(pop.gametes,gamete_recycling_bin,pop.neutral,pop.selected,
+                                                rec_pol,p2g1,p2g2,pop.mutations).first;
+        pop.gametes[offspring.first].n++;
+        pop.gametes[offspring.second].n++;
+        offspring.first = mutate(r,pop,mu,mmodel,offspring.first);
+        offspring.second = mutate(r,pop,mu,mmodel,offspring.second);
+
+        std::size_t slot;
+        if(free_slots.empty())
+        {
+            slot = pop.diploids.size();
+            pop.diploids.push_back(offspring);
+            where.push_back(std::size_t(npos));
+            fitnesses.resize(std::max(2*pop.diploids.size(),fitnesses.size()));
+        }
+        else
+        {
+            slot = free_slots.back();
+            free_slots.pop_back();
+        }
+        auto & dip = pop.diploids[slot];
+        dip.first = offspring.first;
+        dip.second = offspring.second;
+        double x = (boost::geometry::get<0>(parent1.v.first)+boost::geometry::get<0>(parent2.v.first))/2.0 + gsl_ran_gaussian(r,dispersal);
+        if (x<0.)x=0.;
+        if (x>1.)x=1.;
+        double y = (boost::geometry::get<1>(parent1.v.first)+boost::geometry::get<1>(parent2.v.first))/2.0 + gsl_ran_gaussian(r,dispersal);
+        if (y<0.)y=0.;
+        if (y>1.)y=1.;
+        dip.v = value_t(std::make_pair(typename diploid_t::point(x,y),slot));
+        rtree.insert(dip.v);
+        where[slot] = living.size();
+        living.push_back(slot);
+        fitnesses.set(slot,ff(dip,pop.gametes,pop.mutations));
+        ++nbirths;
+    }
+
+    template<typename poptype, typename mutation_model>
+    std::size_t mutate(const gsl_rng * r, poptype & pop, const double mu,
+                       const mutation_model & mmodel, const std::size_t g)
+    {
+        auto rv = KTfwd::fwdpp_internal::mutate_gamete_recycle(mutation_recycling_bin,gamete_recycling_bin,
+                  r,mu,pop.gametes,pop.mutations,g,mmodel,KTfwd::emplace_back());
+        //If g mutated, its count went down by 1 and it may now be unused
+        if(rv != g && !pop.gametes[g].n) gamete_recycling_bin.push(g);
+        return rv;
+    }
+
+    template<typename poptype>
+    void death(const gsl_rng * r, poptype & pop)
+    {
+        const std::size_t i = gsl_rng_uniform_int(r,living.size());
+        const std::size_t slot = living[i];
+        auto & dip = pop.diploids[slot];
+        rtree.remove(dip.v);
+        fitnesses.set(slot,0.);
+        decrement(pop.gametes,dip.first);
+        decrement(pop.gametes,dip.second);
+        //swap-remove from the living list
+        living[i] = living.back();
+        where[living[i]] = i;
+        living.pop_back();
+        where[slot] = npos;
+        free_slots.push_back(slot);
+        ++ndeaths;
+    }
+};
+}
+#endif
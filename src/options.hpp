@@ -0,0 +1,84 @@
+#ifndef LANDSCAPE_OPTIONS_HPP
+#define LANDSCAPE_OPTIONS_HPP
+
+#include <map>
+#include <set>
+#include <string>
+#include <sstream>
+#include <iostream>
+#include <cstdlib>
+
+namespace landscape
+{
+/*
+ * Optional arguments of the form name=value,
+ * given after the required positional arguments.
+ * Each program asks for the options it knows about
+ * via get(), supplying a default. A call to check()
+ * after that reports any options that were never
+ * asked for, which catches typos.
+ */
+class options
+{
+    std::map<std::string, std::string> values;
+    std::set<std::string> used;
+public:
+    options(int argc, char ** argv, int first) : values(), used()
+    {
+        for(int i = first ; i < argc ; ++i)
+        {
+            std::string arg(argv[i]);
+            auto eq = arg.find('=');
+            if(eq == std::string::npos || eq == 0)
+            {
+                std::cerr << "Error: optional argument " << arg << " is not of the form name=value\n";
+                exit(1);
+            }
+            values[arg.substr(0, eq)] = arg.substr(eq + 1);
+        }
+    }
+
+    bool has(const std::string & name) const
+    {
+        return values.find(name) != values.end();
+    }
+
+    template<typename T>
+    T get(const std::string & name, const T & default_value)
+    {
+        used.insert(name);
+        auto i = values.find(name);
+        if(i == values.end()) return default_value;
+        T rv;
+        std::istringstream in(i->second);
+        if(!(in >> rv))
+        {
+            std::cerr << "Error: could not parse value " << i->second << " for option " << name << '\n';
+            exit(1);
+        }
+        return rv;
+    }
+
+    std::string get(const std::string & name, const char * default_value)
+    {
+        used.insert(name);
+        auto i = values.find(name);
+        return (i == values.end()) ? std::string(default_value) : i->second;
+    }
+
+    void check() const
+    {
+        bool ok = true;
+        for(const auto & v : values)
+        {
+            if(used.find(v.first) == used.end())
+            {
+                std::cerr << "Error: unknown option " << v.first << '\n';
+                ok = false;
+            }
+        }
+        if(!ok) exit(1);
+    }
+};
+}
+#endif
@@ -0,0 +1,181 @@
+/*
+ * Checks that the output does not depend on how diploids are stored
+ * (reorder.hpp) or on the spatial index (autotune.hpp).
+ *
+ * For each mating mode (radius and knn), the wflandscape model is run
+ * from the same seed with each of reorder = none, morton and hilbert, and
+ * each of several indexes: rtrees with different split policies and node
+ * sizes, inserted or bulk loaded, and grids with two cell sizes.
+ * The fixations, and the position and genotype of every diploid in birth
+ * order, must be the same as for reorder=none with the default index.
+ * Any difference is printed, and the exit status is then 1.
+ *
+ * This works because WFLandscapeRules sorts possible mates by birth order
+ * (sort_possible_mates) when sort_mates is true, as it is here.  wflandscape
+ * only turns it on with reorder, autotune or a non-default index, and its
+ * cost is reported by timing the default run with and without it.
+ */
+#include "simtypes.hpp"
+#include "wfrules.hpp"
+#include "models.hpp"
+#include "initial.hpp"
+#include "reorder.hpp"
+#include "autotune.hpp"
+#include "options.hpp"
+#include <cassert> //fwdpp has this missing in one of its headers...
+#include <cstdlib>
+#include <chrono>
+#include <iostream>
+#include <fwdpp/diploid.hh>
+#include <fwdpp/experimental/sample_diploid.hpp>
+#include <fwdpp/sugar/GSLrng_t.hpp>
+
+using rtree_type = landscape::adaptive_index<landscape::csdiploid::value>;
+using rules_type = landscape::WFLandscapeRules<rtree_type>;
+
+struct run_params
+{
+    unsigned N,seed,generations,k;
+    double theta,rho,s,mu,radius,dispersal;
+};
+
+//Run the model, and return its fixations, then the position and
+//mutations of each diploid, in birth order.
+std::vector<double> run(const run_params & p, const landscape::mating_mode mating,
+                        const std::string & reorder, const landscape::index_config & c,
+                        const bool sort_mates)
+{
+    const double mu_n = p.theta/double(4*p.N), littler = p.rho/double(4*p.N);
+    KTfwd::GSLrng_t<KTfwd::GSL_RNG_MT19937> rng(p.seed);
+    landscape::poptype pop(p.N);
+    std::vector<landscape::csdiploid::value> values;
+    landscape::initial_landscape("quadrants",rng.get(),pop,values,1.);
+    rules_type rules(rtree_type(values.begin(),values.end(),c),p.radius,p.dispersal);
+    rules.mating = mating;
+    rules.k = p.k;
+    rules.sort_mates = sort_mates;
+    landscape::poisson_recombination recombination_model(rng.get(),littler);
+    landscape::spatial_fitness fitness_model;
+    unsigned generation = 0;
+    auto mutation_model = landscape::make_infsites_mutation(rng.get(),pop.mut_lookup,&generation,mu_n,p.mu,p.s,1.);
+    landscape::spatial_sorter<decltype(pop.diploids)> sorter(reorder == "hilbert" ? landscape::curve_type::hilbert
+            : landscape::curve_type::morton);
+    for( ; generation < p.generations ; ++generation)
+    {
+        KTfwd::experimental::sample_diploid(rng.get(),pop.gametes,pop.diploids,pop.mutations,pop.mcounts,
+                                            p.N,p.N,mu_n+p.mu,mutation_model,recombination_model,fitness_model,
+                                            pop.neutral,pop.selected,0,rules);
+        KTfwd::update_mutations(pop.mutations,pop.fixations,pop.fixation_times,pop.mut_lookup,pop.mcounts,generation,2*p.N);
+        if(reorder != "none") sorter(pop.diploids,rules);
+    }
+
+    std::vector<double> rv;
+    for(std::size_t i = 0 ; i < pop.fixations.size() ; ++i)
+    {
+        rv.push_back(pop.fixations[i].pos);
+        rv.push_back(pop.fixation_times[i]);
+    }
+    for(std::size_t b = 0 ; b < pop.diploids.size() ; ++b)
+    {
+        const auto & dip = pop.diploids[rules.storage_index.empty() ? b : rules.storage_index[b]];
+        rv.push_back(boost::geometry::get<0>(dip.v.first));
+        rv.push_back(boost::geometry::get<1>(dip.v.first));
+        for(const auto g : {dip.first,dip.second})
+        {
+            rv.push_back(-1.);
+            for(const auto m : pop.gametes[g].mutations) rv.push_back(pop.mutations[m].pos);
+            rv.push_back(-1.);
+            for(const auto m : pop.gametes[g].smutations) rv.push_back(pop.mutations[m].pos);
+        }
+    }
+    return rv;
+}
+
+int main(int argc, char ** argv)
+{
+    if(argc<5)
+    {
+        std::cerr << "Incorrect number of arguments.\n"
+                  << "Usage:\n"
+                  << argv[0] << ' '
+                  << "N "
+                  << "theta "
+                  << "seed "
+                  << "generations\n"
+                  << "\n"
+                  << "Output lines are: differ mating reorder index, for each run that differs from the default,\n"
+                  << "then: runs n, and sort mating seconds_with seconds_without (the default run, with and\n"
+                  << "without sorting possible mates)\n"
+                  << "\n"
+                  << "Optional arguments, given as name=value after generations:\n"
+                  << "rho = 4Nr (default 10)\n"
+                  << "s = selection coefficient (default -0.01)\n"
+                  << "mu = mutation rate to selected variants (default 0.001)\n"
+                  << "radius = mating radius (default 0.1)\n"
+                  << "dispersal = dispersal s.d. (default 0.05)\n"
+                  << "k = # neighbours for knn mating (default 8)\n";
+        exit(0);
+    }
+    int argn = 1;
+    run_params p;
+    p.N = atoi(argv[argn++]);
+    p.theta = atof(argv[argn++]);
+    p.seed = atoi(argv[argn++]);
+    p.generations = atoi(argv[argn++]);
+
+    landscape::options opts(argc,argv,argn);
+    p.rho = opts.get("rho",10.);
+    p.s = opts.get("s",-0.01);
+    p.mu = opts.get("mu",0.001);
+    p.radius = opts.get("radius",0.1);
+    p.dispersal = opts.get("dispersal",0.05);
+    p.k = opts.get("k",8u);
+    opts.check();
+    if(!p.N)
+    {
+        std::cerr << "Error: need N > 0\n";
+        exit(1);
+    }
+
+    //As in wflandscape, the default cell size is the larger of radius and 1/sqrt(N)
+    const double cell = std::max(p.radius,1./std::sqrt(double(p.N)));
+    const std::vector<landscape::index_config> indexes{
+        landscape::index_config(),
+        landscape::index_config(landscape::index_backend::quadratic64,landscape::index_build::bulk),
+        landscape::index_config(landscape::index_backend::rstar16,landscape::index_build::insert),
+        landscape::index_config(landscape::index_backend::linear16,landscape::index_build::bulk),
+        landscape::index_config(landscape::index_backend::grid,landscape::index_build::insert,cell),
+        landscape::index_config(landscape::index_backend::grid,landscape::index_build::bulk,cell/3.)
+    };
+    const std::vector<std::pair<landscape::mating_mode,std::string>> matings{
+        {landscape::mating_mode::radius,"radius"},{landscape::mating_mode::knn,"knn"}
+    };
+
+    unsigned nruns = 0, ndiffer = 0;
+    for(const auto & m : matings)
+    {
+        auto start = std::chrono::steady_clock::now();
+        const auto reference = run(p,m.first,"none",indexes[0],true);
+        const double seconds_sorted = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        start = std::chrono::steady_clock::now();
+        run(p,m.first,"none",indexes[0],false);
+        const double seconds_unsorted = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        for(const std::string reorder : {"none","morton","hilbert"})
+        {
+            for(const auto & c : indexes)
+            {
+                if(reorder == "none" && c == indexes[0]) continue;
+                ++nruns;
+                if(run(p,m.first,reorder,c,true) != reference)
+                {
+                    std::cout << "differ " << m.second << ' ' << reorder << ' '
+                              << landscape::index_config_name(c) << '\n';
+                    ++ndiffer;
+                }
+            }
+        }
+        std::cout << "sort " << m.second << ' ' << seconds_sorted << ' ' << seconds_unsorted << '\n';
+    }
+    std::cout << "runs " << nruns << '\n';
+    return ndiffer ? 1 : 0;
+}
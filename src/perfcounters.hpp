@@ -0,0 +1,95 @@
+#ifndef LANDSCAPE_PERFCOUNTERS_HPP
+#define LANDSCAPE_PERFCOUNTERS_HPP
+
+#include <cstdint>
+#include <cstring>
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+namespace landscape
+{
+/*
+ * Hardware event counter for the calling thread, via Linux's
+ * perf_event_open.  Used by the timing programs to count
+ * cache misses.  If the counter can't be opened (not Linux,
+ * no PMU in a VM, or perf_event_paranoid too high), available()
+ * is false and read() returns -1.
+ */
+class perf_counter
+{
+    int fd;
+public:
+    enum class event { cache_misses, cache_references, dtlb_misses };
+
+    explicit perf_counter(event e) : fd(-1)
+    {
+#ifdef __linux__
+        perf_event_attr attr;
+        std::memset(&attr,0,sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        if(e == event::dtlb_misses)
+        {
+            attr.type = PERF_TYPE_HW_CACHE;
+            attr.config = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+                          | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+        }
+        else
+        {
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = (e == event::cache_misses) ? PERF_COUNT_HW_CACHE_MISSES : PERF_COUNT_HW_CACHE_REFERENCES;
+        }
+        fd = int(syscall(__NR_perf_event_open,&attr,0,-1,-1,0));
+#else
+        (void)e;
+#endif
+    }
+
+    perf_counter(const perf_counter &) = delete;
+    perf_counter & operator=(const perf_counter &) = delete;
+
+    ~perf_counter()
+    {
+#ifdef __linux__
+        if(fd >= 0) close(fd);
+#endif
+    }
+
+    bool available() const
+    {
+        return fd >= 0;
+    }
+
+    void start()
+    {
+#ifdef __linux__
+        if(fd < 0) return;
+        ioctl(fd,PERF_EVENT_IOC_RESET,0);
+        ioctl(fd,PERF_EVENT_IOC_ENABLE,0);
+#endif
+    }
+
+    void stop()
+    {
+#ifdef __linux__
+        if(fd >= 0) ioctl(fd,PERF_EVENT_IOC_DISABLE,0);
+#endif
+    }
+
+    std::int64_t read() const
+    {
+#ifdef __linux__
+        std::int64_t count;
+        if(fd >= 0 && ::read(fd,&count,sizeof(count)) == sizeof(count)) return count;
+#endif
+        return -1;
+    }
+};
+}
+#endif
@@ -0,0 +1,318 @@
+#ifndef LANDSCAPE_PLACEMENT_HPP
+#define LANDSCAPE_PLACEMENT_HPP
+
+#include <new>
+#include <limits>
+#include <vector>
+#include <string>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <sstream>
+#include <utility>
+#include <algorithm>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include "simtypes.hpp"
+
+namespace landscape
+{
+/*
+ * Where the big arrays live: which NUMA nodes, and whether on huge pages.
+ *
+ * By default, memory comes from operator new, and the kernel puts each page
+ * on the NUMA node of the thread that first touches it.  Here, that is
+ * usually the main thread, so threads on other sockets pay for remote
+ * memory.  Random access into N fitnesses also misses the TLB a lot
+ * with 4kB pages.
+ *
+ * The placement is set once for the whole program, via memory_placement(),
+ * and applies to:
+ * 1. Containers using placed_allocator, e.g. those of placed_poptype.
+ *    Allocations of at least min_bytes are mmap'd and placed.
+ * 2. Memory passed to place(), e.g. the rules' fitnesses (wfrules.hpp).
+ *
+ * numa_policy:
+ * none: first touch, as usual.
+ * interleave: pages round-robin over all nodes.
+ * partitioned: the memory is cut into nparts contiguous pieces, and piece
+ *              i prefers node i % (# nodes).  This suits workers that each
+ *              take a contiguous range of diploids.
+ *
+ * huge_pages:
+ * none: the kernel's default.
+ * transparent: madvise(MADV_HUGEPAGE), so that transparent huge pages are used
+ *              when the kernel's setting is "madvise".
+ * explicit: mmap(MAP_HUGETLB), i.e. from the pool of huge pages reserved
+ *           via /proc/sys/vm/nr_hugepages.  If that fails, transparent is used.
+ *
+ * Placement is best effort.  mbind is called via syscall, so libnuma is not
+ * needed.  If it fails, e.g. on a kernel without NUMA support, the memory is used
+ * as is, and the failure is counted in placement_stats().
+ */
+enum class numa_policy { none, interleave, partitioned };
+enum class huge_pages { none, transparent, explicit_ };
+
+struct placement_config
+{
+    numa_policy numa;
+    huge_pages pages;
+    unsigned nparts;
+    std::size_t min_bytes;
+    placement_config() : numa(numa_policy::none),pages(huge_pages::none),nparts(1),min_bytes(std::size_t(1)<<21)
+    {
+    }
+    bool active() const
+    {
+        return numa != numa_policy::none || pages != huge_pages::none;
+    }
+};
+
+//Set this before allocating anything that is to be placed
+inline placement_config & memory_placement()
+{
+    static placement_config config;
+    return config;
+}
+
+struct placement_counters
+{
+    std::atomic<std::uint64_t> placed_bytes,hugetlb_bytes,mbind_failures,madvise_failures;
+};
+
+inline placement_counters & placement_stats()
+{
+    static placement_counters counters{{0},{0},{0},{0}};
+    return counters;
+}
+
+//Parse numa=... and huge_pages=... option values.  Returns false if not valid.
+inline bool parse_placement(const std::string & numa, const std::string & pages, placement_config & config)
+{
+    if(numa == "none") config.numa = numa_policy::none;
+    else if(numa == "interleave") config.numa = numa_policy::interleave;
+    else if(numa == "partitioned") config.numa = numa_policy::partitioned;
+    else return false;
+    if(pages == "none") config.pages = huge_pages::none;
+    else if(pages == "transparent") config.pages = huge_pages::transparent;
+    else if(pages == "explicit") config.pages = huge_pages::explicit_;
+    else return false;
+    return true;
+}
+
+namespace detail
+{
+//From linux/mempolicy.h
+const int mpol_preferred = 1, mpol_interleave = 3;
+const unsigned mpol_mf_move = 1u<<1;
+const std::size_t huge_page_size = std::size_t(1)<<21;
+
+//The online NUMA nodes, from sysfs, e.g. "0-1,4"
+inline const std::vector<unsigned> & numa_nodes()
+{
+    static const std::vector<unsigned> nodes = [] {
+        std::vector<unsigned> rv;
+        std::ifstream in("/sys/devices/system/node/online");
+        std::string list, item;
+        if(in >> list)
+        {
+            std::istringstream items(list);
+            while(std::getline(items,item,','))
+            {
+                unsigned first, last;
+                char dash;
+                std::istringstream range(item);
+                if(!(range >> first)) continue;
+                if(!(range >> dash >> last)) last = first;
+                for(unsigned n = first ; n <= last ; ++n) rv.push_back(n);
+            }
+        }
+        if(rv.empty()) rv.push_back(0);
+        return rv;
+    }();
+    return nodes;
+}
+
+inline bool mbind_range(void * addr, const std::size_t len, const int mode, const std::vector<unsigned> & nodes)
+{
+    const std::size_t bits = 8*sizeof(unsigned long);
+    std::vector<unsigned long> mask(1 + *std::max_element(nodes.begin(),nodes.end())/bits,0);
+    for(auto n : nodes) mask[n/bits] |= 1ul << (n%bits);
+    //The kernel drops the last bit of maxnode, as libnuma notes
+    return syscall(SYS_mbind,addr,len,mode,mask.data(),mask.size()*bits+1,mpol_mf_move) == 0;
+}
+
+inline std::size_t page_size()
+{
+    static const std::size_t p = std::size_t(sysconf(_SC_PAGESIZE));
+    return p;
+}
+}
+
+/* Apply the placement to [p,p+bytes).  Only whole pages within the range are
+ * affected, and pages that have been touched already are moved.
+ * Does nothing if the placement is not active, or the range is smaller than min_bytes.
+ */
+inline void place(void * p, const std::size_t bytes, const placement_config & config = memory_placement())
+{
+    if(!config.active() || bytes < config.min_bytes) return;
+    const std::size_t ps = detail::page_size();
+    auto first = (reinterpret_cast<std::uintptr_t>(p) + ps - 1)/ps*ps;
+    auto last = (reinterpret_cast<std::uintptr_t>(p) + bytes)/ps*ps;
+    if(last <= first) return;
+    void * begin = reinterpret_cast<void *>(first);
+    const std::size_t len = last - first;
+    auto & stats = placement_stats();
+    if(config.pages != huge_pages::none && madvise(begin,len,MADV_HUGEPAGE) != 0)
+    {
+        stats.madvise_failures++;
+    }
+    const auto & nodes = detail::numa_nodes();
+    if(config.numa == numa_policy::interleave)
+    {
+        if(!detail::mbind_range(begin,len,detail::mpol_interleave,nodes)) stats.mbind_failures++;
+    }
+    else if(config.numa == numa_policy::partitioned)
+    {
+        //Pieces are whole huge pages, if huge pages are used
+        const std::size_t unit = (config.pages == huge_pages::none) ? ps : detail::huge_page_size;
+        const std::size_t nparts = std::max(1u,config.nparts);
+        const std::size_t piece = std::max(unit,(len/nparts + unit - 1)/unit*unit);
+        for(std::size_t i = 0 ; i*piece < len ; ++i)
+        {
+            std::vector<unsigned> node(1,nodes[i%nodes.size()]);
+            if(!detail::mbind_range(reinterpret_cast<char *>(begin) + i*piece,std::min(piece,len - i*piece),
+                                    detail::mpol_preferred,node))
+            {
+                stats.mbind_failures++;
+            }
+        }
+    }
+    stats.placed_bytes += len;
+}
+
+/* Allocator for the containers of a population, following memory_placement().
+ * Each block starts with a header that records how it was allocated, so the
+ * placement can be changed while blocks are live.
+ */
+template<typename T>
+struct placed_allocator
+{
+    using value_type = T;
+    using pointer = T *;
+    using const_pointer = const T *;
+    using reference = T &;
+    using const_reference = const T &;
+    using size_type = std::size_t;
+    using difference_type = std::ptrdiff_t;
+    template<typename U>
+    struct rebind
+    {
+        using other = placed_allocator<U>;
+    };
+
+    placed_allocator() noexcept
+    {
+    }
+    template<typename U>
+    placed_allocator(const placed_allocator<U> &) noexcept
+    {
+    }
+
+    //Header size, which keeps T aligned
+    static constexpr std::size_t header = 64;
+    static_assert(alignof(T) <= header,"placed_allocator: over-aligned type");
+
+    pointer allocate(const size_type n, const void * = nullptr)
+    {
+        if(n > max_size()) throw std::bad_alloc();
+        const auto & config = memory_placement();
+        const std::size_t bytes = header + n*sizeof(T);
+        char * base = nullptr;
+        std::size_t mapped = 0;
+        if(config.active() && bytes >= config.min_bytes)
+        {
+            void * p = MAP_FAILED;
+            placement_config c = config;
+            if(config.pages == huge_pages::explicit_)
+            {
+                mapped = (bytes + detail::huge_page_size - 1)/detail::huge_page_size*detail::huge_page_size;
+                p = mmap(nullptr,mapped,PROT_READ|PROT_WRITE,MAP_PRIVATE|MAP_ANONYMOUS|MAP_HUGETLB,-1,0);
+                if(p != MAP_FAILED)
+                {
+                    placement_stats().hugetlb_bytes += mapped;
+                    //Already on huge pages, so no madvise
+                    c.pages = huge_pages::none;
+                }
+            }
+            if(p == MAP_FAILED)
+            {
+                const std::size_t ps = detail::page_size();
+                mapped = (bytes + ps - 1)/ps*ps;
+                p = mmap(nullptr,mapped,PROT_READ|PROT_WRITE,MAP_PRIVATE|MAP_ANONYMOUS,-1,0);
+                if(p == MAP_FAILED) throw std::bad_alloc();
+            }
+            base = static_cast<char *>(p);
+            place(base,mapped,c);
+        }
+        else
+        {
+            base = static_cast<char *>(::operator new(bytes));
+        }
+        *reinterpret_cast<std::size_t *>(base) = mapped;
+        return reinterpret_cast<pointer>(base + header);
+    }
+    void deallocate(pointer p, const size_type) noexcept
+    {
+        char * base = reinterpret_cast<char *>(p) - header;
+        const std::size_t mapped = *reinterpret_cast<std::size_t *>(base);
+        if(mapped) munmap(base,mapped);
+        else ::operator delete(base);
+    }
+    size_type max_size() const noexcept
+    {
+        return (std::numeric_limits<size_type>::max() - header)/sizeof(T);
+    }
+    template<typename U,typename... args>
+    void construct(U * p, args &&... a)
+    {
+        ::new(static_cast<void *>(p)) U(std::forward<args>(a)...);
+    }
+    template<typename U>
+    void destroy(U * p)
+    {
+        p->~U();
+    }
+};
+
+template<typename T>
+constexpr std::size_t placed_allocator<T>::header;
+
+template<typename T,typename U>
+inline bool operator==(const placed_allocator<T> &, const placed_allocator<U> &) noexcept
+{
+    return true;
+}
+
+template<typename T,typename U>
+inline bool operator!=(const placed_allocator<T> &, const placed_allocator<U> &) noexcept
+{
+    return false;
+}
+
+/* A population whose diploids, gametes and mutations are allocated with
+ * placed_allocator.  Otherwise the same as poptype (simtypes.hpp).
+ */
+template<std::size_t dim>
+using placed_poptype_t = KTfwd::sugar::singlepop<KTfwd::popgenmut,
+      std::vector<KTfwd::popgenmut,placed_allocator<KTfwd::popgenmut>>,
+      std::vector<KTfwd::gamete,placed_allocator<KTfwd::gamete>>,
+      std::vector<csdiploid_t<dim>,placed_allocator<csdiploid_t<dim>>>,
+      decltype(std::declval<poptype_t<dim>>().fixations),
+      decltype(std::declval<poptype_t<dim>>().fixation_times),
+      decltype(std::declval<poptype_t<dim>>().mut_lookup)>;
+using placed_poptype = placed_poptype_t<2>;
+}
+#endif
@@ -0,0 +1,105 @@
+#ifndef LANDSCAPE_POLICIES_HPP
+#define LANDSCAPE_POLICIES_HPP
+
+#include <cstddef>
+#include <gsl/gsl_rng.h>
+#include <gsl/gsl_randist.h>
+#include <boost/geometry/core/access.hpp>
+
+namespace landscape
+{
+//How the second parent is found.
+//radius: all diploids within the mating radius of parent 1.
+//knn: the k nearest neighbours of parent 1.
+//deme: approximately radius, via a grid of demes (see demes.hpp).
+//rejection: exactly radius, by rejection sampling (see rejection.hpp).
+enum class mating_mode { radius, knn, deme, rejection };
+
+/* Policies for WFLandscapeRules (wfrules.hpp).
+ *
+ * A mating policy decides how pick2 finds parent 2, and
+ * whether w() has to build the grid of demes or the grid
+ * for rejection sampling.  A dispersal
+ * policy places an offspring given its parents.  Both are
+ * template parameters of the rules, so that the choice
+ * costs nothing per pick, and the compiler can inline
+ * the one that is used.
+ */
+
+//The mating mode is the rules' "mating" member, chosen at run time.
+//This is the default.
+struct runtime_mating
+{
+    template<typename rules_t,typename diploid_t>
+    static inline std::size_t pick2(rules_t & rules, const gsl_rng * r, const std::size_t p1, const diploid_t & parent1)
+    {
+        switch(rules.mating)
+        {
+        case mating_mode::knn:
+            return rules.pick2_knn(r,p1,parent1);
+        case mating_mode::deme:
+            return rules.demes.pick(r,p1);
+        case mating_mode::rejection:
+            return rules.pick2_rejection(r,p1,parent1);
+        default:
+            return rules.pick2_radius(r,p1,parent1);
+        }
+    }
+    template<typename rules_t>
+    static inline bool uses_demes(const rules_t & rules)
+    {
+        return rules.mating == mating_mode::deme;
+    }
+    template<typename rules_t>
+    static inline bool uses_rejection(const rules_t & rules)
+    {
+        return rules.mating == mating_mode::rejection;
+    }
+};
+
+//The mating mode is fixed at compile time, and the
+//rules' "mating" member is ignored.
+template<mating_mode mode>
+struct fixed_mating
+{
+    template<typename rules_t,typename diploid_t>
+    static inline std::size_t pick2(rules_t & rules, const gsl_rng * r, const std::size_t p1, const diploid_t & parent1)
+    {
+        if(mode == mating_mode::knn) return rules.pick2_knn(r,p1,parent1);
+        if(mode == mating_mode::deme) return rules.demes.pick(r,p1);
+        if(mode == mating_mode::rejection) return rules.pick2_rejection(r,p1,parent1);
+        return rules.pick2_radius(r,p1,parent1);
+    }
+    template<typename rules_t>
+    static inline bool uses_demes(const rules_t &)
+    {
+        return mode == mating_mode::deme;
+    }
+    template<typename rules_t>
+    static inline bool uses_rejection(const rules_t &)
+    {
+        return mode == mating_mode::rejection;
+    }
+};
+
+//Offspring are at the midpoint of their parents plus
+//Gaussian dispersal independently along each axis,
+//clamped to the landscape.
+//Another option for linear dispersal is
+//https://www.gnu.org/software/gsl/manual/html_node/Spherical-Vector-Distributions.html
+struct gaussian_dispersal
+{
+    template<typename point_t>
+    static inline point_t place(const gsl_rng * r, const point_t & parent1, const point_t & parent2, const double sd)
+    {
+        double x = (boost::geometry::get<0>(parent1)+boost::geometry::get<0>(parent2))/2.0 + gsl_ran_gaussian(r,sd);
+        if (x<0.)x=0.;
+        if (x>1.)x=1.;
+        double y = (boost::geometry::get<1>(parent1)+boost::geometry::get<1>(parent2))/2.0 + gsl_ran_gaussian(r,sd);
+        if (y<0.)y=0.;
+        if (y>1.)y=1.;
+        return point_t(x,y);
+    }
+};
+}
+#endif
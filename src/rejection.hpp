@@ -0,0 +1,161 @@
+#ifndef LANDSCAPE_REJECTION_HPP
+#define LANDSCAPE_REJECTION_HPP
+
+#include <vector>
+#include <cmath>
+#include <limits>
+#include <cstdint>
+#include <algorithm>
+#include <gsl/gsl_rng.h>
+#include <boost/geometry/core/access.hpp>
+
+namespace landscape
+{
+/*
+ * Exact mate choice within the mating radius by rejection sampling.
+ *
+ * The exact rule picks parent 2 from everyone within r of parent 1,
+ * proportional to fitness.  Enumerating them costs O(# neighbours) per pick.
+ * Here, the landscape is cut into square cells a little larger than r, so
+ * that everyone within r of parent 1 is in the 3x3 block of cells around
+ * parent 1's cell.  A pick then repeats:
+ * 1. propose a member of the block uniformly, i.e. a cell with
+ *    probability proportional to its count, then a member of that cell.
+ * 2. reject the proposal if it is further than r from parent 1.
+ * 3. otherwise, accept it with probability w/w_max, where w_max is the
+ *    largest fitness in the block.
+ * Each diploid within r is accepted with probability w/(n w_max) per try,
+ * where n is the size of the block, so the one accepted has the exact
+ * distribution.  The expected # of tries is about 9/pi times w_max over the
+ * mean fitness, whatever the density.
+ *
+ * pick gives up after max_tries, and then the caller uses the enumeration
+ * instead.  That is still exact, and bounds the cost when fitnesses in the
+ * block are very unequal, or parent 1 is alone within r but not in its block.
+ *
+ * Diploids are kept in birth order within a cell, so results do not
+ * depend on where diploids are stored.
+ */
+class rejection_grid
+{
+    unsigned G;      //# cells per side
+    double h;        //cell size
+    double radius;   //radius that G was computed for
+    //cell of each diploid, and the diploids sorted by cell, with their
+    //coordinates and fitnesses in the same order
+    std::vector<unsigned> cell_of;
+    std::vector<std::size_t> cell_start, members, next;
+    std::vector<double> x, y, w;
+    //largest fitness in each cell
+    std::vector<double> cell_max;
+
+    inline unsigned coord(double v) const
+    {
+        auto c = (v > 0.) ? unsigned(v/h) : 0u;
+        return (c >= G) ? G-1 : c;
+    }
+
+    void set_radius(double r)
+    {
+        radius = r;
+        //Cells at least as large as r, with a margin so that rounding
+        //cannot put someone within r outside the 3x3 block,
+        //and at most 4096^2 of them
+        G = unsigned(std::max(1.,std::min(4096.,std::floor(1.0/(r*(1.0 + 1e-9))))));
+        h = 1.0/double(G);
+    }
+public:
+    //Returned by pick when it gives up
+    static constexpr std::size_t failed = std::numeric_limits<std::size_t>::max();
+
+    rejection_grid() : G(0),h(1.),radius(-1.),cell_of(),cell_start(),members(),next(),
+        x(),y(),w(),cell_max()
+    {
+    }
+
+    /* Bin the diploids.  fitnesses are in the order
+     * of diploids.  If not empty, storage_index[b] is where the b-th diploid
+     * born is stored (see WFLandscapeRules).
+     */
+    template<typename dipcont_t>
+    void build(const dipcont_t & diploids, const std::vector<double> & fitnesses,
+               const std::vector<std::size_t> & storage_index, const double r)
+    {
+        using boost::geometry::get;
+        if(r != radius) set_radius(r);
+        const std::size_t N = diploids.size(), ncells = std::size_t(G)*G;
+        cell_of.resize(N);
+        cell_start.assign(ncells+1,0);
+        for(std::size_t i = 0 ; i < N ; ++i)
+        {
+            cell_of[i] = coord(get<1>(diploids[i].v.first))*G + coord(get<0>(diploids[i].v.first));
+            cell_start[cell_of[i]+1]++;
+        }
+        for(std::size_t c = 0 ; c < ncells ; ++c) cell_start[c+1] += cell_start[c];
+        //counting sort, in birth order
+        members.resize(N);
+        x.resize(N);
+        y.resize(N);
+        w.resize(N);
+        cell_max.assign(ncells,0.);
+        next.assign(cell_start.begin(),cell_start.end()-1);
+        for(std::size_t b = 0 ; b < N ; ++b)
+        {
+            auto i = storage_index.empty() ? b : storage_index[b];
+            auto j = next[cell_of[i]]++;
+            members[j] = i;
+            x[j] = get<0>(diploids[i].v.first);
+            y[j] = get<1>(diploids[i].v.first);
+            w[j] = fitnesses[i];
+            cell_max[cell_of[i]] = std::max(cell_max[cell_of[i]],w[j]);
+        }
+    }
+
+    /* Pick parent 2 for the diploid stored at p1, at (p1x,p1y),
+     * from those within radius of it.  The distance is computed
+     * as in WFLandscapeRules::pick2_radius, so the same diploids qualify.
+     * Returns failed if no one was accepted in max_tries, and right away if
+     * p1 is alone in its block or the block's fitnesses are all 0.
+     * tries is incremented by the # of proposals.
+     */
+    inline std::size_t pick(const gsl_rng * r, const std::size_t p1, const double p1x, const double p1y,
+                            const unsigned max_tries, std::uint64_t & tries) const
+    {
+        const std::size_t c = cell_of[p1];
+        const unsigned ix = unsigned(c%G), iy = unsigned(c/G);
+        std::size_t start[9], count[9], n = 0;
+        double wmax = 0.;
+        int ncells = 0;
+        for(unsigned jy = (iy ? iy-1 : 0) ; jy <= std::min(G-1,iy+1) ; ++jy)
+        {
+            for(unsigned jx = (ix ? ix-1 : 0) ; jx <= std::min(G-1,ix+1) ; ++jx)
+            {
+                const std::size_t c2 = std::size_t(jy)*G + jx;
+                start[ncells] = cell_start[c2];
+                count[ncells] = cell_start[c2+1] - cell_start[c2];
+                n += count[ncells++];
+                wmax = std::max(wmax,cell_max[c2]);
+            }
+        }
+        if(n <= 1 || !(wmax > 0.)) return failed;
+        for(unsigned t = 0 ; t < max_tries ; ++t)
+        {
+            ++tries;
+            std::size_t j = std::min(n-1,std::size_t(gsl_rng_uniform(r)*double(n)));
+            int k = 0;
+            while(j >= count[k]) j -= count[k++];
+            j += start[k];
+            const double euclid = std::sqrt(std::pow(p1x-x[j],2.0)+std::pow(p1y-y[j],2.0));
+            if(euclid > radius) continue;
+            if(gsl_rng_uniform(r)*wmax < w[j]) return members[j];
+        }
+        return failed;
+    }
+
+    unsigned cells_per_side() const
+    {
+        return G;
+    }
+};
+}
+#endif
@@ -0,0 +1,257 @@
+/*
+ * Checks that rejection sampling of mates (rejection.hpp) has the same
+ * distribution as the enumeration in WFLandscapeRules::pick2_radius.
+ *
+ * Diploids are put at random on the landscape, with log-normal fitnesses,
+ * a fraction of which are 0.  For each of a number of first parents,
+ * the exact probability of picking each diploid within the radius is its
+ * fitness over the sum of fitnesses within the radius.  Each sampler then
+ * picks parent 2 many times, and chi-square tests compare the counts
+ * with the exact probabilities, and the two samplers' counts with each
+ * other.  Mates with expected counts below 5 are pooled.  One more first
+ * parent is put in a corner with no one else nearby, to check that forced
+ * selfing is still detected.
+ *
+ * If the samplers are right, the p-values look like uniform draws,
+ * and no pick is of a diploid that cannot be picked.  The exit status is 1
+ * if there is such a pick, if the corner parent is not always forced to
+ * self, or if a summary test's p-value is below alpha.
+ */
+#include "simtypes.hpp"
+#include "wfrules.hpp"
+#include "options.hpp"
+#include <cassert> //fwdpp has this missing in one of its headers...
+#include <cstdlib>
+#include <chrono>
+#include <iostream>
+#include <fwdpp/sugar/GSLrng_t.hpp>
+#include <gsl/gsl_randist.h>
+#include <gsl/gsl_cdf.h>
+#include <boost/geometry/index/rtree.hpp>
+
+namespace bgi = boost::geometry::index;
+
+using rtree_type = bgi::rtree< landscape::csdiploid::value, bgi::quadratic<16> >;
+using rules_type = landscape::WFLandscapeRules<rtree_type>;
+
+//Chi-square statistic and degrees of freedom
+struct chisq
+{
+    double x2;
+    unsigned df;
+    chisq() : x2(0.),df(0)
+    {
+    }
+    double p() const
+    {
+        return df ? gsl_cdf_chisq_Q(x2,double(df)) : 1.;
+    }
+};
+
+int main(int argc, char ** argv)
+{
+    if(argc<6)
+    {
+        std::cerr << "Incorrect number of arguments.\n"
+                  << "Usage:\n"
+                  << argv[0] << ' '
+                  << "N "
+                  << "radius "
+                  << "seed "
+                  << "nparents "
+                  << "npicks\n"
+                  << "\n"
+                  << "Output lines are: parent neighbours radius_x2 radius_p rejection_x2 rejection_p two_sample_x2 two_sample_p df,\n"
+                  << "then: selfing forced_selfs_radius forced_selfs_rejection npicks,\n"
+                  << "bad radius_bad rejection_bad (picks that are impossible under the exact rule),\n"
+                  << "summary test x2 df p fraction_p<0.05 fraction_p<0.01 (over all parents),\n"
+                  << "and: time radius_seconds rejection_seconds tries_per_pick fallbacks\n"
+                  << "\n"
+                  << "Optional arguments, given as name=value after npicks:\n"
+                  << "sigma = s.d. of log fitness (default 0.5)\n"
+                  << "zero = fraction of diploids with fitness 0 (default 0.1)\n"
+                  << "clusters = if > 0, diploids are in this many Gaussian clusters of s.d. 2*radius (default 0)\n"
+                  << "alpha = fail if a summary p-value is below this (default 1e-3)\n";
+        exit(0);
+    }
+    int argn = 1;
+    const unsigned N = atoi(argv[argn++]);
+    const double radius = atof(argv[argn++]);
+    const unsigned seed = atoi(argv[argn++]);
+    const unsigned nparents = atoi(argv[argn++]);
+    const unsigned npicks = atoi(argv[argn++]);
+
+    landscape::options opts(argc,argv,argn);
+    const double sigma = opts.get("sigma",0.5);
+    const double zero = opts.get("zero",0.1);
+    const unsigned clusters = opts.get("clusters",0u);
+    const double alpha = opts.get("alpha",1e-3);
+    opts.check();
+    if(N < 2 || radius <= 0. || !nparents || !npicks)
+    {
+        std::cerr << "Error: need N > 1, radius > 0, nparents > 0 and npicks > 0\n";
+        exit(1);
+    }
+
+    KTfwd::GSLrng_t<KTfwd::GSL_RNG_MT19937> rng(seed);
+    const gsl_rng * r = rng.get();
+
+    //The last diploid is alone in the corner at (1,1), so no one else
+    //may be within 3 radii of it.
+    std::vector<landscape::csdiploid> diploids(N,landscape::csdiploid(0,0));
+    std::vector<double> fitness(N);
+    std::vector<std::pair<double,double>> centres;
+    for(unsigned c = 0 ; c < clusters ; ++c) centres.emplace_back(gsl_rng_uniform(r),gsl_rng_uniform(r));
+    auto clamp01 = [](double x) {
+        return std::max(0.,std::min(1.,x));
+    };
+    for(unsigned i = 0 ; i < N ; ++i)
+    {
+        double x = 1., y = 1.;
+        while(i < N-1 && std::pow(1.-x,2.0) + std::pow(1.-y,2.0) < 9.*radius*radius)
+        {
+            if(clusters)
+            {
+                const auto & c = centres[gsl_rng_uniform_int(r,clusters)];
+                x = clamp01(c.first + gsl_ran_gaussian(r,2.*radius));
+                y = clamp01(c.second + gsl_ran_gaussian(r,2.*radius));
+            }
+            else
+            {
+                x = gsl_rng_uniform(r);
+                y = gsl_rng_uniform(r);
+            }
+        }
+        diploids[i].v = landscape::csdiploid::value(landscape::csdiploid::point(x,y),i);
+        fitness[i] = (gsl_rng_uniform(r) < zero) ? 0. : std::exp(gsl_ran_gaussian(r,sigma));
+    }
+    std::vector<landscape::csdiploid::value> values;
+    for(const auto & d : diploids) values.push_back(d.v);
+
+    //There is one gamete, and no mutations, as the fitnesses come from "fitness"
+    std::vector<KTfwd::gamete> gametes(1,KTfwd::gamete(2*N));
+    const std::vector<KTfwd::popgenmut> mutations;
+    rules_type rules(rtree_type(values.begin(),values.end()),radius,0.);
+    rules.mating = landscape::mating_mode::rejection;
+    rules.w(diploids,gametes,mutations,[&fitness](const landscape::csdiploid & d,
+            const std::vector<KTfwd::gamete> &, const std::vector<KTfwd::popgenmut> &) {
+        return fitness[d.v.second];
+    });
+
+    //First parents with someone to pick, and the one in the corner
+    std::vector<std::size_t> parents;
+    std::vector<double> prob(N);
+    auto exact = [&](const std::size_t p1) {
+        const double p1x = boost::geometry::get<0>(diploids[p1].v.first);
+        const double p1y = boost::geometry::get<1>(diploids[p1].v.first);
+        double sumw = 0.;
+        unsigned n = 0;
+        for(std::size_t i = 0 ; i < N ; ++i)
+        {
+            const double euclid = std::sqrt(std::pow(p1x-boost::geometry::get<0>(diploids[i].v.first),2.0)+
+                                             std::pow(p1y-boost::geometry::get<1>(diploids[i].v.first),2.0));
+            prob[i] = (euclid <= radius) ? fitness[i] : 0.;
+            n += (euclid <= radius);
+            sumw += prob[i];
+        }
+        if(n == 1)
+        {
+            std::fill(prob.begin(),prob.end(),0.);
+            prob[p1] = 1.;
+            return n;
+        }
+        for(auto & p : prob) p = (sumw > 0.) ? p/sumw : 0.;
+        return (sumw > 0.) ? n : 0u;
+    };
+    for(unsigned tries = 0 ; parents.size() < nparents && tries < 100*nparents ; ++tries)
+    {
+        const std::size_t p1 = std::size_t(gsl_rng_uniform_int(r,N-1));
+        if(exact(p1) > 1) parents.push_back(p1);
+    }
+    parents.push_back(N-1);
+
+    chisq total_radius,total_rejection,total_two;
+    unsigned nsig[3][2] = {{0,0},{0,0},{0,0}};
+    std::uint64_t bad[2] = {0,0};
+    std::uint64_t forced[2] = {0,0};
+    double seconds[2] = {0.,0.};
+    std::vector<unsigned> counts[2] = {std::vector<unsigned>(N),std::vector<unsigned>(N)};
+    const landscape::mating_mode modes[2] = {landscape::mating_mode::radius,landscape::mating_mode::rejection};
+    for(const auto p1 : parents)
+    {
+        const unsigned n = exact(p1);
+        for(int m = 0 ; m < 2 ; ++m)
+        {
+            rules.mating = modes[m];
+            std::fill(counts[m].begin(),counts[m].end(),0u);
+            const auto forced_before = rules.nforced_selfs;
+            auto start = std::chrono::steady_clock::now();
+            for(unsigned j = 0 ; j < npicks ; ++j)
+            {
+                counts[m][rules.pick2(r,p1,0.,diploids[p1],gametes,mutations)]++;
+            }
+            std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+            seconds[m] += elapsed.count();
+            forced[m] += rules.nforced_selfs - forced_before;
+        }
+        if(p1 == N-1) continue;
+
+        //Pool mates expected fewer than 5 times
+        chisq gof[2],two;
+        double pooled_e = 0.;
+        unsigned pooled_o[2] = {0,0};
+        unsigned nbins = 0;
+        for(std::size_t i = 0 ; i < N ; ++i)
+        {
+            for(int m = 0 ; m < 2 ; ++m) if(prob[i] == 0. && counts[m][i]) bad[m] += counts[m][i];
+            if(prob[i] == 0.) continue;
+            const double e = prob[i]*double(npicks);
+            if(e < 5.)
+            {
+                pooled_e += e;
+                for(int m = 0 ; m < 2 ; ++m) pooled_o[m] += counts[m][i];
+                continue;
+            }
+            for(int m = 0 ; m < 2 ; ++m) gof[m].x2 += std::pow(double(counts[m][i]) - e,2.0)/e;
+            const double e2 = double(counts[0][i] + counts[1][i])/2.;
+            if(e2 > 0.) two.x2 += (std::pow(double(counts[0][i]) - e2,2.0) + std::pow(double(counts[1][i]) - e2,2.0))/e2;
+            ++nbins;
+        }
+        if(pooled_e > 0.)
+        {
+            for(int m = 0 ; m < 2 ; ++m) gof[m].x2 += std::pow(double(pooled_o[m]) - pooled_e,2.0)/pooled_e;
+            const double e2 = double(pooled_o[0] + pooled_o[1])/2.;
+            if(e2 > 0.) two.x2 += (std::pow(double(pooled_o[0]) - e2,2.0) + std::pow(double(pooled_o[1]) - e2,2.0))/e2;
+            ++nbins;
+        }
+        gof[0].df = gof[1].df = two.df = nbins ? nbins-1 : 0;
+        std::cout << p1 << ' ' << n << ' ' << gof[0].x2 << ' ' << gof[0].p() << ' '
+                  << gof[1].x2 << ' ' << gof[1].p() << ' ' << two.x2 << ' ' << two.p() << ' ' << two.df << '\n';
+        chisq * totals[3] = {&total_radius,&total_rejection,&total_two};
+        const chisq * tests[3] = {&gof[0],&gof[1],&two};
+        for(int t = 0 ; t < 3 ; ++t)
+        {
+            totals[t]->x2 += tests[t]->x2;
+            totals[t]->df += tests[t]->df;
+            if(tests[t]->p() < 0.05) nsig[t][0]++;
+            if(tests[t]->p() < 0.01) nsig[t][1]++;
+        }
+    }
+    //The corner parent's picks must all be forced selfs
+    std::cout << "selfing " << forced[0] << ' ' << forced[1] << ' ' << npicks << '\n';
+    std::cout << "bad " << bad[0] << ' ' << bad[1] << '\n';
+    const double ntested = double(parents.size() - 1);
+    const char * names[3] = {"radius","rejection","two_sample"};
+    const chisq * totals[3] = {&total_radius,&total_rejection,&total_two};
+    bool failed = bad[0] + bad[1] > 0 || forced[0] != npicks || forced[1] != npicks;
+    for(int t = 0 ; t < 3 ; ++t)
+    {
+        failed = failed || totals[t]->p() < alpha;
+        std::cout << "summary " << names[t] << ' ' << totals[t]->x2 << ' ' << totals[t]->df << ' ' << totals[t]->p() << ' '
+                  << double(nsig[t][0])/ntested << ' ' << double(nsig[t][1])/ntested << '\n';
+    }
+    std::cout << "time " << seconds[0] << ' ' << seconds[1] << ' '
+              << double(rules.nrejection_tries)/double(npicks*parents.size()) << ' '
+              << rules.nrejection_fallbacks << '\n';
+    return failed ? 1 : 0;
+}
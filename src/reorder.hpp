@@ -0,0 +1,138 @@
+#ifndef LANDSCAPE_REORDER_HPP
+#define LANDSCAPE_REORDER_HPP
+
+#include <vector>
+#include <cstdint>
+#include <numeric>
+#include <algorithm>
+#include <boost/geometry/core/access.hpp>
+#include "indexquery.hpp"
+
+namespace landscape
+{
+/*
+ * Space-filling curve order for diploids.
+ *
+ * fwdpp fills pop.diploids in birth order, which has nothing to
+ * do with where offspring are on the landscape.  So, the diploids
+ * returned by a query on the rtree, and their fitnesses, are scattered
+ * all over memory.  Sorting the diploids along a space-filling curve
+ * after each generation puts spatial neighbours next to each other in memory.
+ *
+ * WFLandscapeRules records the birth order of each diploid (birth_order),
+ * and uses it when picking parents, so that reordering changes where diploids
+ * are stored, but not the outcome of the simulation.
+ */
+enum class curve_type { morton, hilbert };
+
+namespace detail
+{
+//Map a coordinate in [0,1] to a 16-bit integer
+inline std::uint32_t curve_coord(double x)
+{
+    if(x < 0.) x = 0.;
+    if(x > 1.) x = 1.;
+    return std::uint32_t(x*65535.0);
+}
+
+//Spread the lower 16 bits of x out to the even bits
+inline std::uint32_t spread_bits(std::uint32_t x)
+{
+    x &= 0x0000ffff;
+    x = (x | (x << 8)) & 0x00ff00ff;
+    x = (x | (x << 4)) & 0x0f0f0f0f;
+    x = (x | (x << 2)) & 0x33333333;
+    x = (x | (x << 1)) & 0x55555555;
+    return x;
+}
+}
+
+//Z-order key: the bits of x and y, interleaved
+inline std::uint32_t morton_key(double x, double y)
+{
+    return detail::spread_bits(detail::curve_coord(x)) | (detail::spread_bits(detail::curve_coord(y)) << 1);
+}
+
+//Distance along a Hilbert curve filling a 2^16 x 2^16 grid.
+//Better locality than Morton order, at a few more operations per key.
+inline std::uint32_t hilbert_key(double x, double y)
+{
+    std::uint32_t ix = detail::curve_coord(x), iy = detail::curve_coord(y), d = 0;
+    for(std::uint32_t s = (1u << 15) ; s > 0 ; s >>= 1)
+    {
+        std::uint32_t rx = (ix & s) ? 1 : 0, ry = (iy & s) ? 1 : 0;
+        d += s*s*((3*rx)^ry);
+        //rotate the quadrant
+        if(!ry)
+        {
+            if(rx)
+            {
+                ix = 0xffff - ix;
+                iy = 0xffff - iy;
+            }
+            std::swap(ix,iy);
+        }
+    }
+    return d;
+}
+
+/*
+ * Reorders diploids after a generation.  The buffers
+ * are kept between generations so that there are no
+ * allocations after the first call.
+ */
+template<typename dipcont_t>
+class spatial_sorter
+{
+    std::vector<std::uint32_t> keys;
+    std::vector<std::size_t> perm;
+    dipcont_t temp;
+    std::vector<typename dipcont_t::value_type::value> values;
+public:
+    curve_type curve;
+    explicit spatial_sorter(curve_type c) : keys(),perm(),temp(),values(),curve(c)
+    {
+    }
+
+    /* Sort diploids along the curve.  This must be called after
+     * sample_diploid, i.e. when diploids are the offspring
+     * and the rules' offspring rtree indexes them.  The offspring
+     * rtree is rebuilt with the new indexes, using the bulk-loading
+     * constructor, and the rules' birth order is updated.
+     */
+    template<typename rules_t>
+    void operator()(dipcont_t & diploids, rules_t & rules)
+    {
+        using boost::geometry::get;
+        const std::size_t N = diploids.size();
+        keys.resize(N);
+        for(std::size_t i = 0 ; i < N ; ++i)
+        {
+            double x = get<0>(diploids[i].v.first), y = get<1>(diploids[i].v.first);
+            keys[i] = (curve == curve_type::hilbert) ? hilbert_key(x,y) : morton_key(x,y);
+        }
+        perm.resize(N);
+        std::iota(perm.begin(),perm.end(),0);
+        //stable, so that ties are broken by birth order
+        std::stable_sort(perm.begin(),perm.end(),[this](std::size_t a, std::size_t b) {
+            return keys[a] < keys[b];
+        });
+        temp.resize(N);
+        values.resize(N);
+        for(std::size_t i = 0 ; i < N ; ++i)
+        {
+            temp[i] = diploids[perm[i]];
+            temp[i].v.second = i;
+            values[i] = temp[i].v;
+        }
+        diploids.swap(temp);
+        //The offspring were born in order 0 to N-1, so
+        //perm maps storage index to birth order.
+        rules.birth_order.swap(perm);
+        rules.storage_index.resize(N);
+        for(std::size_t i = 0 ; i < N ; ++i) rules.storage_index[rules.birth_order[i]] = i;
+        rebuild_index(rules.offspring_rtree,values.begin(),values.end());
+    }
+};
+}
+#endif
@@ -0,0 +1,358 @@
+/*
+ * Microbenchmarks of the spatial indexes that could hold
+ * the diploids: boost's rtree, with each splitting algorithm
+ * at several node sizes, and grid_index (gridindex.hpp).
+ *
+ * For each index, distribution of points and number of points N,
+ * the operations timed are:
+ * bulk: build the index from all N points at once
+ * box: queries for everything in a box of side 2*radius
+ * radius: queries for everything within radius, as in
+ *         WFLandscapeRules::pick2_radius
+ * knn: queries for the k nearest neighbours
+ * insert: build the index by inserting the N points one at a time
+ * remove: remove points one at a time from that index
+ *
+ * Queries are centred on randomly-chosen points.  The distributions are:
+ * uniform: uniform on [0,1]^2
+ * clustered: one Gaussian cloud with s.d. 0.025, as in rtree_wtf.cc
+ * edge: uniform plus Gaussian noise with s.d. 0.25, clamped to [0,1]^2.
+ *       This piles points up on the edges, as WFLandscapeRules::update does
+ *       when dispersal is large.
+ *
+ * Output is CSV, one line per operation:
+ * index,distribution,N,operation,count,seconds,ns_per_op,results,checksum
+ * where count is the # of operations timed, results is the total # of values
+ * they returned, and checksum is the sum of the labels of those values.
+ * For box and radius queries, results and checksum are the same for every
+ * index.  For knn they can differ when distances are tied, e.g. on the edges.
+ */
+#include "simtypes.hpp"
+#include "gridindex.hpp"
+#include "options.hpp"
+#include <cassert> //fwdpp has this missing in one of its headers...
+#include <cstdlib>
+#include <cstdint>
+#include <cmath>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+#include <sstream>
+#include <algorithm>
+#include <iostream>
+#include <fwdpp/sugar/GSLrng_t.hpp>
+#include <gsl/gsl_randist.h>
+#include <boost/geometry.hpp>
+#include <boost/geometry/index/rtree.hpp>
+
+namespace bg = boost::geometry;
+namespace bgi = boost::geometry::index;
+
+using value = landscape::csdiploid::value;
+using point = landscape::csdiploid::point;
+using box = bg::model::box<point>;
+
+struct bench_params
+{
+    std::string distribution;
+    std::size_t N,nqueries;
+    unsigned k;
+    double radius;
+    std::vector<value> values;
+    //Where the queries are centred, and what gets removed
+    std::vector<std::size_t> query_points;
+};
+
+struct tally
+{
+    std::uint64_t results,checksum;
+    tally() : results(0),checksum(0)
+    {
+    }
+    void operator()(const value & v)
+    {
+        ++results;
+        checksum += v.second;
+    }
+};
+
+//Output iterator that tallies values rather than storing them
+struct tally_iterator
+{
+    tally * t;
+    tally_iterator & operator*()
+    {
+        return *this;
+    }
+    tally_iterator & operator++()
+    {
+        return *this;
+    }
+    tally_iterator & operator++(int)
+    {
+        return *this;
+    }
+    tally_iterator & operator=(const value & v)
+    {
+        (*t)(v);
+        return *this;
+    }
+};
+
+template<typename F>
+double seconds(F f)
+{
+    auto start = std::chrono::steady_clock::now();
+    f();
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count();
+}
+
+void report(const std::string & index, const bench_params & p, const char * operation,
+            const std::size_t count, const double s, const tally & t)
+{
+    std::cout << index << ',' << p.distribution << ',' << p.N << ',' << operation << ','
+              << count << ',' << s << ',' << 1e9*s/double(count) << ','
+              << t.results << ',' << t.checksum << '\n';
+}
+
+void make_points(const gsl_rng * r, bench_params & p)
+{
+    auto clamp = [](double x) {
+        return std::min(1.,std::max(0.,x));
+    };
+    p.values.clear();
+    p.values.reserve(p.N);
+    for(std::size_t i = 0 ; i < p.N ; ++i)
+    {
+        double x,y;
+        if(p.distribution == "clustered")
+        {
+            x = clamp(0.5 + gsl_ran_gaussian(r,0.025));
+            y = clamp(0.5 + gsl_ran_gaussian(r,0.025));
+        }
+        else if(p.distribution == "edge")
+        {
+            x = clamp(gsl_rng_uniform(r) + gsl_ran_gaussian(r,0.25));
+            y = clamp(gsl_rng_uniform(r) + gsl_ran_gaussian(r,0.25));
+        }
+        else
+        {
+            x = gsl_rng_uniform(r);
+            y = gsl_rng_uniform(r);
+        }
+        p.values.emplace_back(point(x,y),i);
+    }
+    p.query_points.resize(p.nqueries);
+    for(auto & q : p.query_points) q = gsl_rng_uniform_int(r,p.N);
+}
+
+template<typename rtree_params>
+void bench_rtree(const std::string & name, const bench_params & p)
+{
+    using rtree_type = bgi::rtree<value,rtree_params>;
+    const double r = p.radius, r2 = r*r;
+    tally t;
+    {
+        std::unique_ptr<rtree_type> tree;
+        double s = seconds([&] { tree.reset(new rtree_type(p.values.begin(),p.values.end())); });
+        t.results = tree->size();
+        report(name,p,"bulk",p.N,s,t);
+
+        t = tally();
+        s = seconds([&] {
+            for(auto q : p.query_points)
+            {
+                const double x = bg::get<0>(p.values[q].first), y = bg::get<1>(p.values[q].first);
+                tree->query(bgi::intersects(box(point(x-r,y-r),point(x+r,y+r))),tally_iterator{&t});
+            }
+        });
+        report(name,p,"box",p.nqueries,s,t);
+
+        t = tally();
+        s = seconds([&] {
+            for(auto q : p.query_points)
+            {
+                const double x = bg::get<0>(p.values[q].first), y = bg::get<1>(p.values[q].first);
+                tree->query(bgi::intersects(box(point(x-r,y-r),point(x+r,y+r))) &&
+                bgi::satisfies([x,y,r2](const value & v) {
+                    const double dx = x - bg::get<0>(v.first), dy = y - bg::get<1>(v.first);
+                    return dx*dx + dy*dy <= r2;
+                }),tally_iterator{&t});
+            }
+        });
+        report(name,p,"radius",p.nqueries,s,t);
+
+        t = tally();
+        s = seconds([&] {
+            for(auto q : p.query_points)
+            {
+                tree->query(bgi::nearest(p.values[q].first,p.k),tally_iterator{&t});
+            }
+        });
+        report(name,p,"knn",p.nqueries,s,t);
+    }
+    rtree_type tree;
+    t = tally();
+    double s = seconds([&] {
+        for(const auto & v : p.values) tree.insert(v);
+    });
+    t.results = tree.size();
+    report(name,p,"insert",p.N,s,t);
+
+    t = tally();
+    s = seconds([&] {
+        for(auto q : p.query_points) t.results += tree.remove(p.values[q]);
+    });
+    report(name,p,"remove",p.nqueries,s,t);
+}
+
+void bench_grid(const std::string & name, const bench_params & p)
+{
+    using grid_type = landscape::grid_index<value>;
+    const double r = p.radius;
+    tally t;
+    {
+        std::unique_ptr<grid_type> grid;
+        double s = seconds([&] { grid.reset(new grid_type(p.values.begin(),p.values.end(),r)); });
+        t.results = grid->size();
+        report(name,p,"bulk",p.N,s,t);
+
+        t = tally();
+        s = seconds([&] {
+            for(auto q : p.query_points)
+            {
+                const double x = bg::get<0>(p.values[q].first), y = bg::get<1>(p.values[q].first);
+                grid->query_box(x-r,y-r,x+r,y+r,tally_iterator{&t});
+            }
+        });
+        report(name,p,"box",p.nqueries,s,t);
+
+        t = tally();
+        s = seconds([&] {
+            for(auto q : p.query_points)
+            {
+                const double x = bg::get<0>(p.values[q].first), y = bg::get<1>(p.values[q].first);
+                grid->query_radius(x,y,r,tally_iterator{&t});
+            }
+        });
+        report(name,p,"radius",p.nqueries,s,t);
+
+        t = tally();
+        s = seconds([&] {
+            for(auto q : p.query_points)
+            {
+                const double x = bg::get<0>(p.values[q].first), y = bg::get<1>(p.values[q].first);
+                grid->nearest(x,y,p.k,tally_iterator{&t});
+            }
+        });
+        report(name,p,"knn",p.nqueries,s,t);
+    }
+    grid_type grid(r);
+    t = tally();
+    double s = seconds([&] {
+        for(const auto & v : p.values) grid.insert(v);
+    });
+    t.results = grid.size();
+    report(name,p,"insert",p.N,s,t);
+
+    t = tally();
+    s = seconds([&] {
+        for(auto q : p.query_points) t.results += grid.remove(p.values[q]);
+    });
+    report(name,p,"remove",p.nqueries,s,t);
+}
+
+//Split a comma-separated list
+std::vector<std::string> split(const std::string & s)
+{
+    std::vector<std::string> rv;
+    std::istringstream in(s);
+    std::string item;
+    while(std::getline(in,item,',')) if(!item.empty()) rv.push_back(item);
+    return rv;
+}
+
+int main(int argc, char ** argv)
+{
+    if(argc > 1 && std::string(argv[1]).find('=') == std::string::npos)
+    {
+        std::cerr << "Usage:\n"
+                  << argv[0] << " [name=value ...]\n"
+                  << "\n"
+                  << "Optional arguments:\n"
+                  << "sizes = comma-separated list of N (default 1000,10000,100000,1000000,10000000)\n"
+                  << "distributions = any of uniform,clustered,edge (default all)\n"
+                  << "indexes = any of linear,quadratic,rstar,grid, or e.g. quadratic16 (default all)\n"
+                  << "queries = # of each kind of query, and of removals (default 100000)\n"
+                  << "radius = query radius.  If 0, the default, sqrt(32/(pi N)), which is\n"
+                  << "         32 neighbours on average for uniform points.\n"
+                  << "k = # nearest neighbours (default 8)\n"
+                  << "seed = random number seed (default 42)\n"
+                  << "\n"
+                  << "Output is CSV on stdout.  See rtree_bench.cc for the columns.\n";
+        exit(0);
+    }
+    landscape::options opts(argc,argv,1);
+    const auto sizes = split(opts.get("sizes","1000,10000,100000,1000000,10000000"));
+    const auto distributions = split(opts.get("distributions","uniform,clustered,edge"));
+    const auto indexes = split(opts.get("indexes","linear,quadratic,rstar,grid"));
+    const std::size_t nqueries = opts.get("queries",std::size_t(100000));
+    const double radius = opts.get("radius",0.);
+    const unsigned k = opts.get("k",8u);
+    const unsigned seed = opts.get("seed",42u);
+    opts.check();
+    for(const auto & d : distributions)
+    {
+        if(d != "uniform" && d != "clustered" && d != "edge")
+        {
+            std::cerr << "Error: unknown distribution " << d << '\n';
+            exit(1);
+        }
+    }
+
+    //Each index is run if its name, or the name without the node size, was asked for
+    auto wanted = [&indexes](const std::string & name, const std::string & family) {
+        return std::find(indexes.begin(),indexes.end(),name) != indexes.end() ||
+               std::find(indexes.begin(),indexes.end(),family) != indexes.end();
+    };
+
+    KTfwd::GSLrng_t<KTfwd::GSL_RNG_MT19937> rng(seed);
+    std::cout << "index,distribution,N,operation,count,seconds,ns_per_op,results,checksum\n";
+    bench_params p;
+    p.k = k;
+    p.nqueries = nqueries;
+    for(const auto & d : distributions)
+    {
+        for(const auto & n : sizes)
+        {
+            p.distribution = d;
+            p.N = std::size_t(std::atof(n.c_str()));
+            if(!p.N)
+            {
+                std::cerr << "Error: bad size " << n << '\n';
+                exit(1);
+            }
+            p.radius = (radius > 0.) ? radius : std::sqrt(32./(M_PI*double(p.N)));
+            make_points(rng.get(),p);
+#define LANDSCAPE_BENCH_RTREE(family,size) \
+            if(wanted(#family #size,#family)) bench_rtree<bgi::family<size>>(#family #size,p);
+            LANDSCAPE_BENCH_RTREE(linear,8)
+            LANDSCAPE_BENCH_RTREE(linear,16)
+            LANDSCAPE_BENCH_RTREE(linear,32)
+            LANDSCAPE_BENCH_RTREE(linear,64)
+            LANDSCAPE_BENCH_RTREE(quadratic,8)
+            LANDSCAPE_BENCH_RTREE(quadratic,16)
+            LANDSCAPE_BENCH_RTREE(quadratic,32)
+            LANDSCAPE_BENCH_RTREE(quadratic,64)
+            LANDSCAPE_BENCH_RTREE(rstar,8)
+            LANDSCAPE_BENCH_RTREE(rstar,16)
+            LANDSCAPE_BENCH_RTREE(rstar,32)
+            LANDSCAPE_BENCH_RTREE(rstar,64)
+#undef LANDSCAPE_BENCH_RTREE
+            if(wanted("grid","grid")) bench_grid("grid",p);
+            std::cout.flush();
+        }
+    }
+}
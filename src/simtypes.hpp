@@ -13,13 +13,19 @@
 
 namespace landscape
 {
-struct csdiploid : public KTfwd::tags::custom_diploid_t
+template<std::size_t dim>
+struct csdiploid_t : public KTfwd::tags::custom_diploid_t
 /*
  * Minimal custom diploid in Cartesian space. Inherits fwdpp tag so
  * that it gets "dispatched" properly.
+ *
+ * The template parameter is the dimension of the landscape.
+ * boost::geometry's point constructor ignores the coordinates
+ * beyond dim, so the NaN initialization below works for 1 to 3 dimensions.
  */
 {
-    using point = boost::geometry::model::point<double, 2, boost::geometry::cs::cartesian>;
+    static constexpr std::size_t dimension = dim;
+    using point = boost::geometry::model::point<double, dim, boost::geometry::cs::cartesian>;
     //A "value" is an x,y coordinate,
     //plus a size_t, which is the index where 
     //this diploid is stored in the population.
@@ -31,18 +37,22 @@ struct csdiploid : public KTfwd::tags::custom_diploid_t
     first_type first; //first gamete
     second_type second;//second gamete
     value v;           //location in space & index in population
-    csdiploid() noexcept : v(std::make_pair(point(std::numeric_limits<double>::quiet_NaN(),
+    csdiploid_t() noexcept : v(std::make_pair(point(std::numeric_limits<double>::quiet_NaN(),
                                                 std::numeric_limits<double>::quiet_NaN()),
                                                 std::numeric_limits<std::size_t>::max()))
     {
     }
-    csdiploid(std::size_t i,std::size_t j) : first(i),second(j),
+    csdiploid_t(std::size_t i,std::size_t j) : first(i),second(j),
         v(std::make_pair(point(std::numeric_limits<double>::quiet_NaN(),
                                std::numeric_limits<double>::quiet_NaN()),
                          std::numeric_limits<std::size_t>::max()))
     {
     }
 };
+//The usual 2-d landscape
+using csdiploid = csdiploid_t<2>;
+//A linear landscape (river, coastline...)
+using csdiploid1d = csdiploid_t<1>;
 /*
  * Our population is a single deme.  The mutation type
  * is KTfwd::popgenmut, from fwdpp/sugar/popgenmut.hpp.
@@ -50,13 +60,17 @@ struct csdiploid : public KTfwd::tags::custom_diploid_t
  * position, s, h as its main data members.  The origin
  * time of mutations is also recorded.
  *
- * The diploid type is our csdiploid defined above.
+ * The diploid type is our csdiploid defined above,
+ * or its 1-d equivalent.
  *
  * For more details, see the definition of a "singlepop"
  * in fwdpp/sugar/singlepop and the files included from there.
  *
  * The fwdpp manual online has detailed info, too.
  */
-using poptype = KTfwd::singlepop<KTfwd::popgenmut,csdiploid>;
+template<std::size_t dim>
+using poptype_t = KTfwd::singlepop<KTfwd::popgenmut,csdiploid_t<dim>>;
+using poptype = poptype_t<2>;
+using poptype1d = poptype_t<1>;
 }
 #endif
@@ -0,0 +1,336 @@
+#ifndef LANDSCAPE_SIMULATION_HPP
+#define LANDSCAPE_SIMULATION_HPP
+
+#include <string>
+#include <vector>
+#include <cmath>
+#include <memory>
+#include <cstdint>
+#include <fwdpp/diploid.hh>
+#include <fwdpp/experimental/sample_diploid.hpp>
+#include <fwdpp/sugar/infsites.hpp>
+#include <gsl/gsl_rng.h>
+#include <gsl/gsl_randist.h>
+#include <boost/geometry/index/rtree.hpp>
+#include "simtypes.hpp"
+#include "wfrules.hpp"
+#include "models.hpp"
+#include "initial.hpp"
+#include "fixations.hpp"
+
+namespace landscape
+{
+//Parameters of the wflandscape model.  See the README.
+struct landscape_params
+{
+    unsigned N;
+    double theta,rho,s,h,mu,radius,dispersal;
+    mating_mode mating;
+    unsigned k;
+    double max_distance;
+    //The initial landscape (see initial.hpp)
+    std::string initial;
+    //If false, update_mutations is called every generation,
+    //rather than only when needed (see fixations.hpp)
+    bool adaptive_prune;
+    landscape_params() : N(0),theta(0.),rho(0.),s(0.),h(0.),mu(0.),radius(0.),dispersal(0.),
+        mating(mating_mode::radius),k(8),max_distance(0.),initial("quadrants"),adaptive_prune(true)
+    {
+    }
+};
+
+/*
+ * Derive the seed of replicate (or branch) rep from a base seed.  This is
+ * splitmix64, so that neighbouring base seeds and replicates give
+ * unrelated streams.  The result fits in an unsigned, so that any
+ * replicate can be re-run by hand with wflandscape.
+ */
+inline unsigned replicate_seed(const std::uint64_t base, const std::uint64_t rep)
+{
+    std::uint64_t z = base*0x9e3779b97f4a7c15ULL + rep + 0x9e3779b97f4a7c15ULL;
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    z ^= (z >> 31);
+    return unsigned(z & 0xffffffffULL);
+}
+
+//Read-only view of a contiguous array.  Does not own the data.
+template<typename T>
+struct array_view
+{
+    const T * data;
+    std::size_t size;
+    const T * begin() const
+    {
+        return data;
+    }
+    const T * end() const
+    {
+        return data + size;
+    }
+    const T & operator[](const std::size_t i) const
+    {
+        return data[i];
+    }
+};
+
+/*
+ * The wflandscape model as an object, for use from other programs.
+ *
+ * reset() sets up a population, as wflandscape does, and step(k)
+ * runs k generations.  In between steps, the population can be looked
+ * at via the views below, and the parameters changed in place via params().
+ * Changes take effect at the next generation.
+ *
+ * A simulation can be copied, including the state of its random number
+ * generator, so a copy continues exactly as the original would.
+ * branch(seed) makes a copy with a new seed.  So, a burn-in can be
+ * run once, and many continuations branched from it in memory.
+ *
+ * reset() keeps the memory allocated for the previous population, so one
+ * object can be used for many replicates (see wflandscape_batch.cc).
+ *
+ * After reset(p,seed) and step(10*p.N), the population is the
+ * same as wflandscape's with that seed and default options.
+ */
+template<typename rtree_type = boost::geometry::index::rtree<csdiploid::value,boost::geometry::index::quadratic<16>>>
+class landscape_simulation
+{
+public:
+    using rules_type = WFLandscapeRules<rtree_type>;
+private:
+    using rng_ptr = std::unique_ptr<gsl_rng,void(*)(gsl_rng *)>;
+    landscape_params p;
+    rng_ptr rng;
+    poptype pop;
+    rules_type rules;
+    unsigned generation;
+    //Caches behind the positions() and fitnesses() views.  values is
+    //also where reset() puts the initial landscape.
+    mutable std::vector<csdiploid::value> values;
+    mutable std::vector<double> current_fitnesses;
+    mutable bool values_current,fitnesses_current;
+    fixation_schedule fixations;
+public:
+    landscape_simulation() : p(),rng(gsl_rng_alloc(gsl_rng_mt19937),gsl_rng_free),pop(0),
+        rules(rtree_type(),0.,0.),generation(0),values(),current_fitnesses(),
+        values_current(false),fitnesses_current(false),
+        fixations()
+    {
+    }
+
+    landscape_simulation(const landscape_params & p_, const unsigned seed) : landscape_simulation()
+    {
+        reset(p_,seed);
+    }
+
+    landscape_simulation(const landscape_simulation & other) :
+        p(other.p),rng(gsl_rng_clone(other.rng.get()),gsl_rng_free),pop(other.pop),
+        rules(other.rules),generation(other.generation),values(),
+        current_fitnesses(other.current_fitnesses),values_current(false),fitnesses_current(other.fitnesses_current),
+        fixations(other.fixations)
+    {
+    }
+
+    landscape_simulation(landscape_simulation &&) = default;
+    landscape_simulation & operator=(landscape_simulation &&) = default;
+
+    landscape_simulation & operator=(const landscape_simulation & other)
+    {
+        landscape_simulation temp(other);
+        return *this = std::move(temp);
+    }
+
+    //A copy that continues with a different seed
+    landscape_simulation branch(const unsigned seed) const
+    {
+        landscape_simulation rv(*this);
+        gsl_rng_set(rv.rng.get(),seed);
+        return rv;
+    }
+
+    //Start a new population, placed on the landscape as in wflandscape.
+    //Throws std::runtime_error if p.initial is bad.
+    void reset(const landscape_params & p_, const unsigned seed)
+    {
+        p = p_;
+        const unsigned N = p.N;
+        gsl_rng_set(rng.get(),seed);
+        generation = 0;
+        values_current = fitnesses_current = false;
+        fixations.reset();
+
+        //clear() and assign() keep capacity.
+        pop.N = N;
+        pop.mutations.clear();
+        pop.mcounts.clear();
+        pop.mut_lookup.clear();
+        pop.fixations.clear();
+        pop.fixation_times.clear();
+        pop.gametes.assign(1,KTfwd::gamete(2*N));
+        pop.diploids.assign(N,csdiploid(0,0));
+        pop.mutations.reserve(size_t(std::ceil(std::log(2*N)*p.theta+0.667*p.theta)));
+
+        //Possible mates are not sorted (see WFLandscapeRules::sort_mates),
+        //so the output depends on how the rtree is built.  As in wflandscape,
+        //the diploids are inserted in order.
+        initial_landscape(p.initial,rng.get(),pop,values,p.h);
+        rtree_type rtree;
+        for(const auto & v : values) rtree.insert(v);
+        rules.reset(std::move(rtree));
+    }
+
+    //Run k generations
+    void step(const unsigned k = 1)
+    {
+        const unsigned N_curr = unsigned(pop.diploids.size()), N_next = p.N;
+        const double mu_n = p.theta/double(4*p.N);
+        const double littler = p.rho/double(4*p.N);
+        rules.radius = p.radius;
+        rules.dispersal = p.dispersal;
+        rules.mating = p.mating;
+        rules.k = p.k;
+        rules.max_distance = p.max_distance;
+
+        //The models refer to this object's rng and generation,
+        //so they are made here rather than stored, which keeps
+        //the object copyable.
+        gsl_rng * r = rng.get();
+        poisson_recombination recombination_model(r,littler);
+        spatial_fitness fitness_model;
+        auto mutation_model = make_infsites_mutation(r,pop.mut_lookup,&generation,mu_n,p.mu,p.s,p.h);
+        for(unsigned i = 0 ; i < k ; ++i, ++generation)
+        {
+            KTfwd::experimental::sample_diploid(r,
+                                                pop.gametes,
+                                                pop.diploids,
+                                                pop.mutations,
+                                                pop.mcounts,
+                                                i ? N_next : N_curr,
+                                                N_next,
+                                                mu_n+p.mu,
+                                                mutation_model,
+                                                recombination_model,
+                                                fitness_model,
+                                                pop.neutral,pop.selected,
+                                                0,
+                                                rules);
+            if(p.adaptive_prune) fixations(pop,generation,2*N_next);
+            else
+            {
+                KTfwd::update_mutations(pop.mutations,pop.fixations,pop.fixation_times,pop.mut_lookup,pop.mcounts,generation,2*N_next);
+                fixations.reset();
+            }
+        }
+        pop.N = N_next;
+        values_current = fitnesses_current = false;
+    }
+
+    //The parameters, which may be changed between steps
+    landscape_params & params()
+    {
+        return p;
+    }
+
+    const landscape_params & params() const
+    {
+        return p;
+    }
+
+    //# generations run since reset
+    unsigned time() const
+    {
+        return generation;
+    }
+
+    /* Views of the current generation.
+     * They are valid until the next call to step or reset.
+     * Diploids may not be stored in birth order,
+     * see WFLandscapeRules::storage_index.
+     * positions() and fitnesses() fill a cache on first use after
+     * each step, so they must not be called from several threads
+     * at once on the same object.
+     */
+    const poptype & population() const
+    {
+        return pop;
+    }
+
+    array_view<csdiploid> diploids() const
+    {
+        return array_view<csdiploid>{pop.diploids.data(),pop.diploids.size()};
+    }
+
+    array_view<KTfwd::gamete> gametes() const
+    {
+        return array_view<KTfwd::gamete>{pop.gametes.data(),pop.gametes.size()};
+    }
+
+    array_view<KTfwd::popgenmut> mutations() const
+    {
+        return array_view<KTfwd::popgenmut>{pop.mutations.data(),pop.mutations.size()};
+    }
+
+    //The location and birth index of each diploid, in the same order
+    //as diploids().  boost::geometry::get<0>(positions()[i].first) is x(i).
+    array_view<csdiploid::value> positions() const
+    {
+        if(!values_current)
+        {
+            values.resize(pop.diploids.size());
+            for(std::size_t i = 0 ; i < pop.diploids.size() ; ++i) values[i] = pop.diploids[i].v;
+            values_current = true;
+        }
+        return array_view<csdiploid::value>{values.data(),values.size()};
+    }
+
+    //Coordinates of diploid i
+    double x(const std::size_t i) const
+    {
+        return boost::geometry::get<0>(pop.diploids[i].v.first);
+    }
+
+    double y(const std::size_t i) const
+    {
+        return boost::geometry::get<1>(pop.diploids[i].v.first);
+    }
+
+    //The rtree of the current generation
+    const rtree_type & index() const
+    {
+        return rules.offspring_rtree;
+    }
+
+    const rules_type & mating_rules() const
+    {
+        return rules;
+    }
+
+    const fixation_schedule & fixation_scheduling() const
+    {
+        return fixations;
+    }
+
+    //Fitness of each diploid in the current generation, as the rules
+    //will use it when they pick parents in the next generation: times
+    //the rules' fitness_modifiers, if any are set.  landscape_simulation
+    //sets none itself.
+    array_view<double> fitnesses() const
+    {
+        if(!fitnesses_current)
+        {
+            spatial_fitness ff;
+            const auto & modifiers = rules.fitness_modifiers;
+            current_fitnesses.resize(pop.diploids.size());
+            for(std::size_t i = 0 ; i < pop.diploids.size() ; ++i)
+            {
+                current_fitnesses[i] = ff(pop.diploids[i],pop.gametes,pop.mutations);
+                if(!modifiers.empty()) current_fitnesses[i] *= modifiers[i];
+            }
+            fitnesses_current = true;
+        }
+        return array_view<double>{current_fitnesses.data(),current_fitnesses.size()};
+    }
+};
+}
+#endif
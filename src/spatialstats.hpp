@@ -0,0 +1,357 @@
+#ifndef LANDSCAPE_SPATIALSTATS_HPP
+#define LANDSCAPE_SPATIALSTATS_HPP
+
+#include <vector>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <thread>
+#include <algorithm>
+#include <iostream>
+#include <boost/geometry.hpp>
+#include <boost/geometry/geometries/box.hpp>
+#include <boost/geometry/index/rtree.hpp>
+#include "indexquery.hpp"
+
+namespace landscape
+{
+/*
+ * In-process spatial summary statistics.
+ *
+ * Instead of dumping every diploid and mutation and
+ * reparsing that in R, we compute the usual spatial
+ * summaries straight from pop.gametes/pop.mutations and
+ * the coordinates stored in csdiploid::v:
+ *
+ * 1. Isolation by distance: mean number of pairwise differences
+ *    between diploids, binned by Euclidean distance.
+ * 2. Spatial Fst: the landscape is cut into a grid, and
+ *    Hs/Ht/Fst are computed treating grid cells as demes.
+ * 3. Local surfaces: per grid cell sample size, expected
+ *    heterozygosity, # segregating sites, mean observed
+ *    heterozygosity, and frequencies of selected mutations.
+ */
+
+/*
+ * Genotypes as bitsets.  Each segregating mutation gets a column,
+ * and each gamete in use gets a row of 64-bit words.  The number
+ * of differences between two gametes is then a popcount
+ * over XOR'd words.
+ */
+struct genotype_bitsets
+{
+    using word_t = std::uint64_t;
+    static constexpr std::size_t npos = std::numeric_limits<std::size_t>::max();
+    //column of each mutation, or npos if not segregating
+    std::vector<std::size_t> column;
+    //mutation index for each column
+    std::vector<std::size_t> keys;
+    //row-major: gametes.size() rows of nwords words
+    std::vector<word_t> bits;
+    std::size_t nwords;
+
+    genotype_bitsets() : column(), keys(), bits(), nwords(0)
+    {
+    }
+
+    template<typename gcont_t, typename mcont_t>
+    void fill(const gcont_t & gametes, const mcont_t & mutations,
+              const std::vector<unsigned> & mcounts)
+    {
+        column.assign(mutations.size(), std::size_t(npos));
+        keys.clear();
+        for(std::size_t i = 0 ; i < mcounts.size() ; ++i)
+        {
+            if(mcounts[i])
+            {
+                column[i] = keys.size();
+                keys.push_back(i);
+            }
+        }
+        nwords = keys.size()/64 + ((keys.size()%64) ? 1 : 0);
+        bits.assign(gametes.size()*nwords, 0);
+        for(std::size_t g = 0 ; g < gametes.size() ; ++g)
+        {
+            if(!gametes[g].n) continue;
+            word_t * row = &bits[g*nwords];
+            for(const auto & k : gametes[g].mutations) set(row, column[k]);
+            for(const auto & k : gametes[g].smutations) set(row, column[k]);
+        }
+    }
+
+    inline const word_t * row(std::size_t g) const
+    {
+        return bits.data() + g*nwords;
+    }
+
+    //# sites differing between gametes g1 and g2
+    inline unsigned differences(std::size_t g1, std::size_t g2) const
+    {
+        const word_t * a = row(g1), * b = row(g2);
+        unsigned d = 0;
+        for(std::size_t i = 0 ; i < nwords ; ++i) d += unsigned(__builtin_popcountll(a[i]^b[i]));
+        return d;
+    }
+
+private:
+    static inline void set(word_t * row, std::size_t c)
+    {
+        if(c != npos) row[c/64] |= (word_t(1) << (c%64));
+    }
+};
+
+struct spatial_stats_params
+{
+    unsigned grid;         //grid is grid x grid cells over [0,1]^2
+    unsigned ibd_bins;     //# distance bins for isolation by distance
+    double ibd_dmax;       //max. distance considered for isolation by distance
+    unsigned nthreads;     //# threads for the pairwise kernel
+    spatial_stats_params() : grid(10), ibd_bins(10), ibd_dmax(0.25), nthreads(1)
+    {
+    }
+};
+
+struct spatial_stats
+{
+    //Isolation by distance.  Bin b covers distances (b*w,(b+1)*w],
+    //where w = ibd_dmax/ibd_bins. Bin 0 also includes distance 0.
+    std::vector<std::uint64_t> ibd_npairs;
+    std::vector<double> ibd_meandiff;
+    //Grid cells are row-major in y, so cell = iy*grid + ix
+    std::vector<unsigned> cell_n, cell_S;
+    std::vector<double> cell_pi, cell_het;
+    //Frequency of each selected mutation (selected_keys) in each cell.
+    //Row-major: cell*selected_keys.size() + j
+    std::vector<std::size_t> selected_keys;
+    std::vector<double> selected_freqs;
+    double Hs, Ht, Fst;
+    spatial_stats() : ibd_npairs(), ibd_meandiff(), cell_n(), cell_S(), cell_pi(), cell_het(),
+        selected_keys(), selected_freqs(), Hs(0.), Ht(0.), Fst(0.)
+    {
+    }
+};
+
+namespace detail
+{
+inline unsigned grid_coord(double x, unsigned grid)
+{
+    auto c = unsigned(x*double(grid));
+    return (c >= grid) ? grid - 1 : c;
+}
+
+template<typename diploid_t>
+inline unsigned grid_cell(const diploid_t & dip, unsigned grid)
+{
+    return grid_coord(boost::geometry::get<1>(dip.v.first), grid)*grid
+           + grid_coord(boost::geometry::get<0>(dip.v.first), grid);
+}
+
+//Mean # differences between two diploids, averaged over the 4 gamete pairings.
+template<typename diploid_t>
+inline double diploid_differences(const genotype_bitsets & b, const diploid_t & a, const diploid_t & c)
+{
+    return double(b.differences(a.first, c.first) + b.differences(a.first, c.second)
+                  + b.differences(a.second, c.first) + b.differences(a.second, c.second))/4.0;
+}
+}
+
+/*
+ * Isolation by distance.  Each diploid queries the rtree for all
+ * neighbours within ibd_dmax, so the cost is O(N*k) rather than O(N^2).
+ * Diploids are dealt to threads round-robin, and each thread keeps
+ * its own histogram, so no locking is needed.  Concurrent queries
+ * on a const rtree are safe.
+ */
+template<typename dipcont_t, typename rtree_type>
+void isolation_by_distance(const dipcont_t & diploids, const rtree_type & rtree,
+                           const genotype_bitsets & bits,
+                           const spatial_stats_params & p, spatial_stats & stats)
+{
+    using value_t = typename dipcont_t::value_type::value;
+    using point_t = typename dipcont_t::value_type::point;
+    namespace bg = boost::geometry;
+
+    const unsigned nthreads = std::max(1u, p.nthreads);
+    const double binwidth = p.ibd_dmax/double(p.ibd_bins);
+    std::vector<std::vector<std::uint64_t>> npairs(nthreads, std::vector<std::uint64_t>(p.ibd_bins, 0));
+    std::vector<std::vector<double>> sumdiff(nthreads, std::vector<double>(p.ibd_bins, 0.));
+
+    auto kernel = [&](unsigned t) {
+        std::vector<value_t> neighbours;
+        for(std::size_t i = t ; i < diploids.size() ; i += nthreads)
+        {
+            double x = bg::get<0>(diploids[i].v.first), y = bg::get<1>(diploids[i].v.first);
+            neighbours.clear();
+            query_box(rtree, point_t(x - p.ibd_dmax, y - p.ibd_dmax), point_t(x + p.ibd_dmax, y + p.ibd_dmax),
+                      std::back_inserter(neighbours));
+            for(const auto & v : neighbours)
+            {
+                //count each pair once
+                if(v.second <= i) continue;
+                double dx = x - bg::get<0>(v.first), dy = y - bg::get<1>(v.first);
+                double d = std::sqrt(dx*dx + dy*dy);
+                if(d > p.ibd_dmax) continue;
+                auto b = (d > 0.) ? unsigned(std::ceil(d/binwidth)) - 1 : 0u;
+                if(b >= p.ibd_bins) b = p.ibd_bins - 1;
+                npairs[t][b]++;
+                sumdiff[t][b] += detail::diploid_differences(bits, diploids[i], diploids[v.second]);
+            }
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for(unsigned t = 1 ; t < nthreads ; ++t) workers.emplace_back(kernel, t);
+    kernel(0);
+    for(auto & w : workers) w.join();
+
+    stats.ibd_npairs.assign(p.ibd_bins, 0);
+    stats.ibd_meandiff.assign(p.ibd_bins, 0.);
+    for(unsigned t = 0 ; t < nthreads ; ++t)
+    {
+        for(unsigned b = 0 ; b < p.ibd_bins ; ++b)
+        {
+            stats.ibd_npairs[b] += npairs[t][b];
+            stats.ibd_meandiff[b] += sumdiff[t][b];
+        }
+    }
+    for(unsigned b = 0 ; b < p.ibd_bins ; ++b)
+    {
+        if(stats.ibd_npairs[b]) stats.ibd_meandiff[b] /= double(stats.ibd_npairs[b]);
+        else stats.ibd_meandiff[b] = std::numeric_limits<double>::quiet_NaN();
+    }
+}
+
+/*
+ * Grid-based statistics.  One pass over the diploids tallies
+ * allele counts per cell for every segregating mutation.
+ */
+template<typename dipcont_t, typename gcont_t, typename mcont_t>
+void grid_statistics(const dipcont_t & diploids, const gcont_t & gametes, const mcont_t & mutations,
+                     const genotype_bitsets & bits,
+                     const spatial_stats_params & p, spatial_stats & stats)
+{
+    const unsigned ncells = p.grid*p.grid;
+    const std::size_t S = bits.keys.size();
+    std::vector<unsigned> counts(std::size_t(ncells)*S, 0);
+    std::vector<unsigned> total(S, 0);
+
+    stats.cell_n.assign(ncells, 0);
+    stats.cell_het.assign(ncells, 0.);
+    for(const auto & dip : diploids)
+    {
+        auto c = detail::grid_cell(dip, p.grid);
+        stats.cell_n[c]++;
+        stats.cell_het[c] += double(bits.differences(dip.first, dip.second));
+        unsigned * cc = counts.data() + std::size_t(c)*S;
+        //A gamete may still carry a mutation whose count is 0,
+        //e.g. one just removed by update_mutations, which has no column
+        auto add = [cc,&total,&bits](const std::size_t k) {
+            const auto col = bits.column[k];
+            if(col == genotype_bitsets::npos) return;
+            cc[col]++;
+            total[col]++;
+        };
+        for(const auto g : {dip.first, dip.second})
+        {
+            for(const auto & k : gametes[g].mutations) add(k);
+            for(const auto & k : gametes[g].smutations) add(k);
+        }
+    }
+
+    stats.selected_keys.clear();
+    for(std::size_t j = 0 ; j < S ; ++j)
+    {
+        if(!mutations[bits.keys[j]].neutral) stats.selected_keys.push_back(j);
+    }
+    stats.selected_freqs.assign(std::size_t(ncells)*stats.selected_keys.size(),
+                                std::numeric_limits<double>::quiet_NaN());
+
+    stats.cell_S.assign(ncells, 0);
+    stats.cell_pi.assign(ncells, 0.);
+    stats.Hs = stats.Ht = 0.;
+    const double twoN = 2.0*double(diploids.size());
+    for(unsigned c = 0 ; c < ncells ; ++c)
+    {
+        if(!stats.cell_n[c]) continue;
+        const double n = 2.0*double(stats.cell_n[c]);
+        const double weight = n/twoN;
+        const unsigned * cc = counts.data() + std::size_t(c)*S;
+        for(std::size_t j = 0 ; j < S ; ++j)
+        {
+            if(!cc[j]) continue;
+            double pc = double(cc[j])/n;
+            if(cc[j] < unsigned(n)) stats.cell_S[c]++;
+            stats.cell_pi[c] += 2.0*pc*(1.0 - pc);
+            stats.Hs += weight*2.0*pc*(1.0 - pc);
+        }
+        //unbiased within-cell heterozygosity
+        stats.cell_pi[c] *= (n > 1.) ? n/(n - 1.) : 0.;
+        stats.cell_het[c] /= double(stats.cell_n[c]);
+        for(std::size_t j = 0 ; j < stats.selected_keys.size() ; ++j)
+        {
+            stats.selected_freqs[std::size_t(c)*stats.selected_keys.size() + j] = double(cc[stats.selected_keys[j]])/n;
+        }
+    }
+    for(std::size_t j = 0 ; j < S ; ++j)
+    {
+        double pt = double(total[j])/twoN;
+        stats.Ht += 2.0*pt*(1.0 - pt);
+    }
+    stats.Fst = (stats.Ht > 0.) ? (stats.Ht - stats.Hs)/stats.Ht : std::numeric_limits<double>::quiet_NaN();
+    //report mutation indexes, not columns
+    for(auto & j : stats.selected_keys) j = bits.keys[j];
+}
+
+/*
+ * Convenience function computing everything.
+ * The rtree must index the current diploids,
+ * e.g. the offspring rtree after a call to sample_diploid.
+ */
+template<typename poptype, typename rtree_type>
+spatial_stats spatial_summaries(const poptype & pop, const rtree_type & rtree,
+                                const spatial_stats_params & p)
+{
+    spatial_stats stats;
+    genotype_bitsets bits;
+    bits.fill(pop.gametes, pop.mutations, pop.mcounts);
+    isolation_by_distance(pop.diploids, rtree, bits, p, stats);
+    grid_statistics(pop.diploids, pop.gametes, pop.mutations, bits, p, stats);
+    return stats;
+}
+
+/*
+ * Output is "tidy", with the generation as the first column
+ * and a record type as the second:
+ * gen ibd bin dmax npairs meandiff
+ * gen fst Hs Ht Fst
+ * gen cell ix iy n pi S het
+ * gen freq ix iy pos s p
+ */
+template<typename mcont_t>
+void write_spatial_stats(std::ostream & o, unsigned generation, const spatial_stats & stats,
+                         const mcont_t & mutations, const spatial_stats_params & p)
+{
+    for(unsigned b = 0 ; b < stats.ibd_npairs.size() ; ++b)
+    {
+        o << generation << " ibd " << b << ' ' << p.ibd_dmax*double(b + 1)/double(p.ibd_bins) << ' '
+          << stats.ibd_npairs[b] << ' ' << stats.ibd_meandiff[b] << '\n';
+    }
+    o << generation << " fst " << stats.Hs << ' ' << stats.Ht << ' ' << stats.Fst << '\n';
+    for(unsigned c = 0 ; c < stats.cell_n.size() ; ++c)
+    {
+        o << generation << " cell " << c%p.grid << ' ' << c/p.grid << ' ' << stats.cell_n[c] << ' '
+          << stats.cell_pi[c] << ' ' << stats.cell_S[c] << ' ' << stats.cell_het[c] << '\n';
+    }
+    for(unsigned c = 0 ; c < stats.cell_n.size() ; ++c)
+    {
+        if(!stats.cell_n[c]) continue;
+        for(std::size_t j = 0 ; j < stats.selected_keys.size() ; ++j)
+        {
+            const auto & m = mutations[stats.selected_keys[j]];
+            o << generation << " freq " << c%p.grid << ' ' << c/p.grid << ' ' << m.pos << ' ' << m.s << ' '
+              << stats.selected_freqs[std::size_t(c)*stats.selected_keys.size() + j] << '\n';
+        }
+    }
+}
+}
+#endif
@@ -0,0 +1,236 @@
+#ifndef LANDSCAPE_TELEMETRY_HPP
+#define LANDSCAPE_TELEMETRY_HPP
+
+#include <atomic>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace landscape
+{
+/*
+ * Live telemetry of a running simulation, in a POSIX shared-memory segment.
+ *
+ * The simulation publishes a telemetry_values once per generation via
+ * telemetry_writer, and any number of other processes read it via
+ * telemetry_reader (see telemetry_watch.cc), without locks and without
+ * the simulation knowing they are there.
+ *
+ * The segment is a seqlock: a sequence number that is odd while the writer
+ * is changing the values, followed by the values as 64-bit atomics.  Publishing
+ * costs two stores to the sequence number plus one relaxed store per value.
+ * A reader copies the values and retries if the sequence number was odd or
+ * changed meanwhile.
+ *
+ * Segments are named /landscape.<something>, and so show up as
+ * /dev/shm/landscape.<something> on Linux.  The writer removes its segment
+ * when it is destroyed.  If a run dies, the segment is left behind, and
+ * the reader reports the run as dead because its pid is gone.
+ */
+struct telemetry_values
+{
+    //generation is the # done so far, out of generations
+    std::uint64_t generation,generations,N;
+    //Mean fitness of the parents of the last generation, as returned by sample_diploid
+    double wbar;
+    //Generations per second, over the last second or so
+    double rate;
+    //Seconds spent so far in sample_diploid, update_mutations, and everything else
+    double seconds_sample,seconds_update,seconds_other;
+    //Sizes of the containers (including unused slots), and # of fixations
+    std::uint64_t mutations,gametes,fixations;
+    //Bytes used, and live mutations and gametes, from memory_usage().
+    //As that is not free, these are updated at most about once a second.
+    std::uint64_t memory,live_mutations,live_gametes;
+    telemetry_values() : generation(0),generations(0),N(0),wbar(0.),rate(0.),
+        seconds_sample(0.),seconds_update(0.),seconds_other(0.),
+        mutations(0),gametes(0),fixations(0),memory(0),live_mutations(0),live_gametes(0)
+    {
+    }
+};
+
+enum class telemetry_state : std::uint64_t { starting = 0, running = 1, finished = 2 };
+
+namespace detail
+{
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2,"telemetry needs lock-free 64-bit atomics");
+const std::uint64_t telemetry_magic = 0x314d454c4554534cull; //"LSTELEM1"
+const std::size_t telemetry_nvalues = sizeof(telemetry_values)/sizeof(std::uint64_t);
+static_assert(sizeof(telemetry_values) == telemetry_nvalues*sizeof(std::uint64_t),
+              "telemetry_values must be made of 64-bit fields");
+
+//The layout of the segment.  magic and pid are written before
+//anyone can find the segment, and never change.
+struct telemetry_segment
+{
+    std::uint64_t magic,pid;
+    std::atomic<std::uint64_t> seq,state,updated; //updated = wall clock time in ms
+    std::atomic<std::uint64_t> values[telemetry_nvalues];
+};
+
+inline std::string telemetry_name(const std::string & name)
+{
+    return (!name.empty() && name[0] == '/') ? name : "/" + name;
+}
+}
+
+class telemetry_writer
+{
+    detail::telemetry_segment * segment;
+    std::string name;
+public:
+    telemetry_writer() : segment(nullptr),name()
+    {
+    }
+    //Create the segment, replacing any old one of the same name.
+    //Throws std::runtime_error if that fails.
+    explicit telemetry_writer(const std::string & name_) : segment(nullptr),name(detail::telemetry_name(name_))
+    {
+        int fd = shm_open(name.c_str(),O_CREAT|O_RDWR|O_TRUNC,0644);
+        if(fd < 0) throw std::runtime_error("could not create shared memory segment " + name);
+        if(ftruncate(fd,sizeof(detail::telemetry_segment)) != 0)
+        {
+            close(fd);
+            shm_unlink(name.c_str());
+            throw std::runtime_error("could not size shared memory segment " + name);
+        }
+        void * p = mmap(nullptr,sizeof(detail::telemetry_segment),PROT_READ|PROT_WRITE,MAP_SHARED,fd,0);
+        close(fd);
+        if(p == MAP_FAILED)
+        {
+            shm_unlink(name.c_str());
+            throw std::runtime_error("could not map shared memory segment " + name);
+        }
+        //The new segment is zero-filled, which is a valid state for the atomics
+        segment = static_cast<detail::telemetry_segment *>(p);
+        segment->pid = std::uint64_t(getpid());
+        segment->magic = detail::telemetry_magic;
+    }
+    telemetry_writer(const telemetry_writer &) = delete;
+    telemetry_writer & operator=(const telemetry_writer &) = delete;
+    ~telemetry_writer()
+    {
+        if(!segment) return;
+        segment->state.store(std::uint64_t(telemetry_state::finished),std::memory_order_release);
+        munmap(segment,sizeof(detail::telemetry_segment));
+        shm_unlink(name.c_str());
+    }
+
+    bool active() const
+    {
+        return segment != nullptr;
+    }
+
+    const std::string & segment_name() const
+    {
+        return name;
+    }
+
+    //Publish v.  Only one thread may call this.
+    void publish(const telemetry_values & v, const std::uint64_t now_ms)
+    {
+        if(!segment) return;
+        std::uint64_t words[detail::telemetry_nvalues];
+        std::memcpy(words,&v,sizeof(words));
+        const auto s = segment->seq.load(std::memory_order_relaxed);
+        segment->seq.store(s+1,std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        for(std::size_t i = 0 ; i < detail::telemetry_nvalues ; ++i)
+        {
+            segment->values[i].store(words[i],std::memory_order_relaxed);
+        }
+        segment->updated.store(now_ms,std::memory_order_relaxed);
+        segment->seq.store(s+2,std::memory_order_release);
+        if(!s) segment->state.store(std::uint64_t(telemetry_state::running),std::memory_order_release);
+    }
+};
+
+//What a reader sees
+struct telemetry_snapshot
+{
+    std::uint64_t pid,updated;
+    telemetry_state state;
+    telemetry_values values;
+};
+
+class telemetry_reader
+{
+    const detail::telemetry_segment * segment;
+public:
+    //Map an existing segment.  Throws std::runtime_error if it is not there,
+    //or is not a telemetry segment.
+    explicit telemetry_reader(const std::string & name_) : segment(nullptr)
+    {
+        const std::string name = detail::telemetry_name(name_);
+        int fd = shm_open(name.c_str(),O_RDONLY,0);
+        if(fd < 0) throw std::runtime_error("could not open shared memory segment " + name);
+        struct stat st;
+        if(fstat(fd,&st) != 0 || std::size_t(st.st_size) < sizeof(detail::telemetry_segment))
+        {
+            close(fd);
+            throw std::runtime_error(name + " is not a telemetry segment");
+        }
+        void * p = mmap(nullptr,sizeof(detail::telemetry_segment),PROT_READ,MAP_SHARED,fd,0);
+        close(fd);
+        if(p == MAP_FAILED) throw std::runtime_error("could not map shared memory segment " + name);
+        segment = static_cast<const detail::telemetry_segment *>(p);
+        if(segment->magic != detail::telemetry_magic)
+        {
+            munmap(const_cast<detail::telemetry_segment *>(segment),sizeof(detail::telemetry_segment));
+            throw std::runtime_error(name + " is not a telemetry segment");
+        }
+    }
+    telemetry_reader(const telemetry_reader &) = delete;
+    telemetry_reader & operator=(const telemetry_reader &) = delete;
+    ~telemetry_reader()
+    {
+        munmap(const_cast<detail::telemetry_segment *>(segment),sizeof(detail::telemetry_segment));
+    }
+
+    //A consistent copy of the values.  Returns false if the writer
+    //was busy for all of max_tries attempts.
+    bool read(telemetry_snapshot & snap, const unsigned max_tries = 1000) const
+    {
+        std::uint64_t words[detail::telemetry_nvalues];
+        for(unsigned t = 0 ; t < max_tries ; ++t)
+        {
+            const auto s1 = segment->seq.load(std::memory_order_acquire);
+            if(s1 & 1) continue;
+            for(std::size_t i = 0 ; i < detail::telemetry_nvalues ; ++i)
+            {
+                words[i] = segment->values[i].load(std::memory_order_relaxed);
+            }
+            snap.updated = segment->updated.load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if(segment->seq.load(std::memory_order_relaxed) != s1) continue;
+            std::memcpy(&snap.values,words,sizeof(words));
+            snap.pid = segment->pid;
+            snap.state = telemetry_state(segment->state.load(std::memory_order_acquire));
+            return true;
+        }
+        return false;
+    }
+};
+
+//Names of the telemetry segments in /dev/shm, i.e. those starting with "landscape."
+inline std::vector<std::string> telemetry_segments()
+{
+    std::vector<std::string> rv;
+    DIR * d = opendir("/dev/shm");
+    if(!d) return rv;
+    while(auto e = readdir(d))
+    {
+        if(std::strncmp(e->d_name,"landscape.",10) == 0) rv.push_back(std::string("/") + e->d_name);
+    }
+    closedir(d);
+    return rv;
+}
+}
+#endif
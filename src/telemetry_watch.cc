@@ -0,0 +1,89 @@
+/*
+ * Print the live telemetry of running simulations (see telemetry.hpp),
+ * one line per run.
+ *
+ * With no names, every /dev/shm/landscape.* segment is read.
+ * Reading does not slow the simulations down: they never wait for a reader.
+ */
+#include "telemetry.hpp"
+#include "options.hpp"
+#include <cerrno>
+#include <cstdlib>
+#include <chrono>
+#include <thread>
+#include <signal.h>
+#include <iomanip>
+#include <iostream>
+
+int main(int argc, char ** argv)
+{
+    if(argc > 1 && (std::string(argv[1]) == "-h" || std::string(argv[1]) == "--help"))
+    {
+        std::cerr << "Usage:\n"
+                  << argv[0] << " [name ...] [name=value ...]\n"
+                  << "\n"
+                  << "name = a run's telemetry name, as given to wflandscape (default: all runs)\n"
+                  << "\n"
+                  << "Optional arguments:\n"
+                  << "interval = t > 0 means print again every t seconds, until interrupted (default 0)\n"
+                  << "\n"
+                  << "Columns are: name pid state generation generations N wbar generations/s\n"
+                  << "sample_% update_% other_% mutations live_mutations gametes live_gametes fixations\n"
+                  << "memory_MB age_s, where the %s are of the time spent so far, and age_s is the\n"
+                  << "time since the run last published.  state is dead if the process is gone.\n";
+        exit(0);
+    }
+    int argn = 1;
+    std::vector<std::string> names;
+    while(argn < argc && std::string(argv[argn]).find('=') == std::string::npos)
+    {
+        names.push_back("/landscape." + std::string(argv[argn++]));
+    }
+    landscape::options opts(argc,argv,argn);
+    const double interval = opts.get("interval",0.);
+    opts.check();
+
+    static const char * states[] = {"starting","running","finished"};
+    for(;;)
+    {
+        std::cout << "name pid state generation generations N wbar generations/s sample_% update_% other_% "
+                  << "mutations live_mutations gametes live_gametes fixations memory_MB age_s\n";
+        const auto now_ms = std::uint64_t(std::chrono::duration_cast<std::chrono::milliseconds>(
+                                              std::chrono::system_clock::now().time_since_epoch()).count());
+        for(const auto & name : names.empty() ? landscape::telemetry_segments() : names)
+        {
+            try
+            {
+                landscape::telemetry_reader reader(name);
+                landscape::telemetry_snapshot snap;
+                if(!reader.read(snap))
+                {
+                    std::cout << name.substr(11) << " NA busy\n";
+                    continue;
+                }
+                const auto & v = snap.values;
+                const bool alive = kill(pid_t(snap.pid),0) == 0 || errno == EPERM;
+                const double total = v.seconds_sample + v.seconds_update + v.seconds_other;
+                auto percent = [total](const double s) {
+                    return total > 0. ? 100.*s/total : 0.;
+                };
+                std::cout << name.substr(11) << ' ' << snap.pid << ' '
+                          << (alive ? states[std::min(std::uint64_t(2),std::uint64_t(snap.state))] : "dead") << ' '
+                          << v.generation << ' ' << v.generations << ' ' << v.N << ' ' << v.wbar << ' ' << v.rate << ' '
+                          << std::fixed << std::setprecision(1)
+                          << percent(v.seconds_sample) << ' ' << percent(v.seconds_update) << ' ' << percent(v.seconds_other) << ' '
+                          << v.mutations << ' ' << v.live_mutations << ' ' << v.gametes << ' ' << v.live_gametes << ' '
+                          << v.fixations << ' ' << double(v.memory)/double(1<<20) << ' '
+                          << (snap.updated ? double(now_ms - std::min(now_ms,snap.updated))/1000. : 0.) << '\n'
+                          << std::defaultfloat << std::setprecision(6);
+            }
+            catch(std::exception & e)
+            {
+                std::cerr << "Error: " << e.what() << '\n';
+            }
+        }
+        if(!(interval > 0.)) break;
+        std::cout.flush();
+        std::this_thread::sleep_for(std::chrono::duration<double>(interval));
+    }
+}
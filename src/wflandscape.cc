@@ -8,9 +8,20 @@
  */
 #include "simtypes.hpp"
 #include "wfrules.hpp"
+#include "spatialstats.hpp"
+#include "options.hpp"
+#include "initial.hpp"
+#include "models.hpp"
+#include "density.hpp"
+#include "reorder.hpp"
+#include "memory.hpp"
+#include "telemetry.hpp"
+#include "autotune.hpp"
+#include "fixations.hpp"
 #include <cassert> //fwdpp has this missing in one of its headers...
 #include <cstdlib>
-#include <functional>
+#include <chrono>
+#include <memory>
 #include <iostream>
 #include <fwdpp/diploid.hh>  //Main fwdpp library header
 #include <fwdpp/experimental/sample_diploid.hpp> //"Experimental" version of WF sampling function
@@ -25,47 +36,99 @@ namespace bg = boost::geometry;
 namespace bgi = boost::geometry::index;
 
 //typedefs to simplify life
-using rtree_type = bgi::rtree< landscape::csdiploid::value, bgi::quadratic<16> >;
-using rules_type = landscape::WFLandscapeRules<rtree_type>;
+/* By default, the index is a boost rtree.  If index, index_build or
+ * cell_size is given, or autotune or memory_log, the index is chosen
+ * at run time instead (see autotune.hpp), and its rtrees count the
+ * memory used by their nodes, for memory_log.  main() picks one of the
+ * two once, so that the default pays for neither.
+ */
+using default_rtree_type = bgi::rtree<landscape::csdiploid::value,bgi::quadratic<16>>;
+using adaptive_rtree_type = landscape::adaptive_index< landscape::csdiploid::value,
+      landscape::counting_allocator<landscape::csdiploid::value> >;
 
-//Arbitrary model for fitness.
-//Treat s as -s in the
-//lower left quandrant of the landscape,
-//otherwise as s.
-//Fitness is multiplicative across sites.
-struct spatial_fitness
+//What the simulation does differently with each kind of index.
+//The initial index is built by inserting the diploids in order, as
+//wflandscape always has: unless possible mates are sorted, the order in
+//which the index returns them, and so the output, depend on how it was built.
+template<typename rtree_type>
+struct index_support
 {
-    /* This function makes a spatial fitness object
-     * behave as a function.
-     * Note: if we had an additional landscape that reflected
-     * how the landscape modified genetic values of fitness,
-     * we could bind it here.
-     */
-    inline double operator()(const landscape::csdiploid & dip,
-                             const std::vector<KTfwd::gamete> & gametes,
-                             const std::vector<KTfwd::popgenmut> & mutations) const
+    static rtree_type build(const std::vector<landscape::csdiploid::value> & values, const landscape::index_config & c)
+    {
+        rtree_type rtree(c);
+        for(const auto & v : values) rtree.insert(v);
+        return rtree;
+    }
+    template<typename dipcont_t>
+    static void tune(landscape::index_autotuner & autotuner, const unsigned generation,
+                     const dipcont_t & diploids, rtree_type & index)
+    {
+        autotuner(generation,diploids,index);
+    }
+    static std::int64_t bytes()
     {
-        double x = boost::geometry::get<0>(dip.v.first);
-        double y = boost::geometry::get<1>(dip.v.first);
-        KTfwd::site_dependent_fitness s;
-        double geographic_factor = 1.0;
-        if(x<=0.5 && y <= 0.5) geographic_factor = -1.0;
+        return landscape::allocated_bytes<landscape::index_memory>();
+    }
+    static std::string name(const rtree_type & index)
+    {
+        return landscape::index_config_name(index.settings());
+    }
+};
 
-        return std::max(0.0,
-                        s(dip,gametes,mutations,
-        [&geographic_factor](double & w,const KTfwd::popgenmut & m) {
-            w *= (1.0 + geographic_factor*2.0*m.s);
-        },
-        [&geographic_factor](double & w,const KTfwd::popgenmut & m) {
-            w *= (1.0 + geographic_factor*m.h*m.s);
-        },
-        1.0));
+//The boost rtree has one configuration, is not tuned, and its memory is not counted
+template<>
+struct index_support<default_rtree_type>
+{
+    static default_rtree_type build(const std::vector<landscape::csdiploid::value> & values, const landscape::index_config &)
+    {
+        default_rtree_type rtree;
+        for(const auto & v : values) rtree.insert(v);
+        return rtree;
+    }
+    template<typename dipcont_t>
+    static void tune(landscape::index_autotuner &, const unsigned, const dipcont_t &, default_rtree_type &)
+    {
+    }
+    static std::int64_t bytes()
+    {
+        return -1;
+    }
+    static std::string name(const default_rtree_type &)
+    {
+        return landscape::index_config_name(landscape::index_config());
     }
 };
 
+struct wflandscape_params
+{
+    unsigned N;
+    double theta,rho,s,h,mu,radius,dispersal;
+    unsigned seed,format;
+    landscape::spatial_stats_params stats;
+    unsigned stats_every;
+    double competition,capacity,growth;
+    std::string mating;
+    unsigned k;
+    double max_distance;
+    bool report;
+    std::string reorder,initial,compact,prune;
+    unsigned prune_every;
+    double compact_dead;
+    unsigned memory_log;
+    std::string telemetry;
+    landscape::index_config index;
+    unsigned autotune;
+    std::string numa,huge_pages;
+    //Sort possible mates by birth order (see wfrules.hpp)
+    bool sort_mates;
+};
+
+template<typename rtree_type>
+void simulate(const wflandscape_params & p);
+
 int main(int argc, char ** argv)
 {
-    if(argc!=11)
+    if(argc<11)
     {
         std::cerr << "Incorrect number of arguments.\n"
                   << "Usage:\n"
@@ -84,20 +147,153 @@ int main(int argc, char ** argv)
                   << "Note: format = 0 means list of diploids + selected mutations\n"
                   << "format = nsam > 0  = ms-style output of nsam diploids + their geographic locations\n"
 				  << "format = N = output info for whole population\n"
-				  << "format > N = bad bad bad\n";
+				  << "format > N = bad bad bad\n"
+                  << "\n"
+                  << "Optional arguments, given as name=value after format:\n"
+                  << "stats = G > 0 means output spatial summary statistics on a GxG grid\n"
+                  << "        instead of the output specified by format\n"
+                  << "stats_every = K > 0 means also output the statistics every K generations\n"
+                  << "ibd_bins = # distance bins for isolation by distance (default 10)\n"
+                  << "ibd_dmax = max. distance for isolation by distance (default 0.25)\n"
+                  << "threads = # threads used for the statistics (default 1)\n"
+                  << "competition = sigma > 0 means local density regulation, where density is\n"
+                  << "              measured with a Gaussian kernel of s.d. sigma.  Population size then varies.\n"
+                  << "capacity = local carrying capacity, in individuals per unit area (default N)\n"
+                  << "growth = expected # offspring per individual at low density (default 2)\n"
+                  << "mating = radius, knn, deme or rejection (default radius)\n"
+                  << "k = # nearest neighbours for knn mating (default 8)\n"
+                  << "max_distance = if > 0, knn mates must be within this distance\n"
+                  << "report = 1 means print selfing statistics to stderr\n"
+                  << "reorder = none, morton or hilbert: sort diploids in memory along this curve\n"
+                  << "          each generation (default none).  Sorts possible mates by birth order, so\n"
+                  << "          morton and hilbert give the same output, but not the same as none.\n"
+                  << "initial = initial landscape: quadrants (default), uniform, clustered:k:sigma,\n"
+                  << "          raster:filename or file:filename (see initial.hpp)\n"
+                  << "compact = adaptive (default) or never: renumber gametes and mutations densely\n"
+                  << "          when more than compact_dead of them are unused (see memory.hpp).\n"
+                  << "          Does not change the output.\n"
+                  << "compact_dead = fraction of unused gametes or mutations that triggers compaction (default 0.5)\n"
+                  << "prune = adaptive (default) or always: call update_mutations only in generations with a fixation,\n"
+                  << "        or every generation (see fixations.hpp).  Does not change the output.\n"
+                  << "prune_every = K > 0 means also call update_mutations every K generations (default 0)\n"
+                  << "numa = none, interleave or partitioned: NUMA placement of the population (default none)\n"
+                  << "huge_pages = none, transparent or explicit (default none)\n"
+                  << "numa_parts = # pieces for numa=partitioned (default: # NUMA nodes)\n"
+                  << "memory_log = K > 0 means print the memory used by each container to stderr\n"
+                  << "             every K generations\n"
+                  << "telemetry = name: publish progress each generation in the shared memory segment\n"
+                  << "            /landscape.name, which telemetry_watch reads.  auto means the process id.\n"
+                  << "index = quadratic16 (default), quadratic64, rstar16, linear16 or grid: the spatial index\n"
+                  << "index_build = insert (default) or bulk: add offspring to the index as they are born,\n"
+                  << "              or pack it once they all are\n"
+                  << "cell_size = grid cell size (default: the larger of radius and 1/sqrt(N))\n"
+                  << "autotune = K > 0 means time every index every K generations, and switch to\n"
+                  << "           the fastest (see autotune.hpp).  Other than the default index, these sort\n"
+                  << "           possible mates by birth order, so they give the same output as each other,\n"
+                  << "           but not the same as the default.\n";
         exit(0);
     }
     int argn = 1;
-    const unsigned N = atoi(argv[argn++]);
-    const double theta = atof(argv[argn++]);
-    const double rho = atof(argv[argn++]);
-    const double s = atof(argv[argn++]);       //selection coefficient
-    const double h = atof(argv[argn++]);       //dominance.  Fitnesses will be 1,1+sh,1+2s, so h=1=additive.
-    const double mu = atof(argv[argn++]);      //mutation rate to selected variants
-    const double radius = atof(argv[argn++]);  //Radius in which to search for mates.
-    const double dispersal = atof(argv[argn++]); //std. deviation in offspring dispersal
-    const unsigned seed = atoi(argv[argn++]);  //RNG seed.
-    const unsigned format = atoi(argv[argn++]);
+    wflandscape_params p;
+    p.N = atoi(argv[argn++]);
+    p.theta = atof(argv[argn++]);
+    p.rho = atof(argv[argn++]);
+    p.s = atof(argv[argn++]);       //selection coefficient
+    p.h = atof(argv[argn++]);       //dominance.  Fitnesses will be 1,1+sh,1+2s, so h=1=additive.
+    p.mu = atof(argv[argn++]);      //mutation rate to selected variants
+    p.radius = atof(argv[argn++]);  //Radius in which to search for mates.
+    p.dispersal = atof(argv[argn++]); //std. deviation in offspring dispersal
+    p.seed = atoi(argv[argn++]);  //RNG seed.
+    p.format = atoi(argv[argn++]);
+
+    landscape::options opts(argc,argv,argn);
+    p.stats.grid = opts.get("stats",0u);
+    p.stats.ibd_bins = opts.get("ibd_bins",p.stats.ibd_bins);
+    p.stats.ibd_dmax = opts.get("ibd_dmax",p.stats.ibd_dmax);
+    p.stats.nthreads = opts.get("threads",p.stats.nthreads);
+    p.stats_every = opts.get("stats_every",0u);
+    p.competition = opts.get("competition",0.);
+    p.capacity = opts.get("capacity",double(p.N));
+    p.growth = opts.get("growth",2.);
+    p.mating = opts.get("mating","radius");
+    p.k = opts.get("k",8u);
+    p.max_distance = opts.get("max_distance",0.);
+    p.report = opts.get("report",0u);
+    p.reorder = opts.get("reorder","none");
+    p.initial = opts.get("initial","quadrants");
+    p.compact = opts.get("compact","adaptive");
+    p.prune = opts.get("prune","adaptive");
+    p.prune_every = opts.get("prune_every",0u);
+    p.compact_dead = opts.get("compact_dead",0.5);
+    p.memory_log = opts.get("memory_log",0u);
+    p.telemetry = opts.get("telemetry",std::string());
+    const std::string index = opts.get("index","quadratic16");
+    const std::string index_build = opts.get("index_build","insert");
+    const double cell_size = opts.get("cell_size",std::max(p.radius,1./std::sqrt(double(std::max(1u,p.N)))));
+    p.autotune = opts.get("autotune",0u);
+    p.numa = opts.get("numa","none");
+    p.huge_pages = opts.get("huge_pages","none");
+    const unsigned numa_parts = opts.get("numa_parts",unsigned(landscape::detail::numa_nodes().size()));
+    opts.check();
+    if(p.mating != "radius" && p.mating != "knn" && p.mating != "deme" && p.mating != "rejection")
+    {
+        std::cerr << "Error: mating must be radius, knn, deme or rejection\n";
+        exit(1);
+    }
+    if(p.reorder != "none" && p.reorder != "morton" && p.reorder != "hilbert")
+    {
+        std::cerr << "Error: reorder must be none, morton or hilbert\n";
+        exit(1);
+    }
+    if(p.compact != "adaptive" && p.compact != "never")
+    {
+        std::cerr << "Error: compact must be adaptive or never\n";
+        exit(1);
+    }
+    if(p.prune != "adaptive" && p.prune != "always")
+    {
+        std::cerr << "Error: prune must be adaptive or always\n";
+        exit(1);
+    }
+    if(!landscape::parse_index_config(index,index_build,cell_size,p.index))
+    {
+        std::cerr << "Error: index must be quadratic16, quadratic64, rstar16, linear16 or grid, "
+                  << "index_build insert or bulk, and cell_size > 0\n";
+        exit(1);
+    }
+    //Must be set before the population is allocated
+    if(!landscape::parse_placement(p.numa,p.huge_pages,landscape::memory_placement()))
+    {
+        std::cerr << "Error: numa must be none, interleave or partitioned, and huge_pages none, transparent or explicit\n";
+        exit(1);
+    }
+    landscape::memory_placement().nparts = numa_parts;
+    //Sorting possible mates keeps the output the same when diploids
+    //are re-ordered, or with any index.  It is not needed otherwise.
+    p.sort_mates = p.reorder != "none" || p.autotune || p.index != landscape::index_config();
+    if(opts.has("index") || opts.has("index_build") || opts.has("cell_size") || p.autotune || p.memory_log)
+    {
+        simulate<adaptive_rtree_type>(p);
+    }
+    else simulate<default_rtree_type>(p);
+}
+
+template<typename rtree_type>
+void simulate(const wflandscape_params & p)
+{
+    using rules_type = landscape::WFLandscapeRules<rtree_type>;
+    const unsigned N = p.N;
+    const double theta = p.theta, rho = p.rho, s = p.s, h = p.h, mu = p.mu;
+    const double radius = p.radius, dispersal = p.dispersal;
+    const unsigned seed = p.seed, format = p.format;
+    const landscape::spatial_stats_params & stats_params = p.stats;
+    const unsigned stats_every = p.stats_every, k = p.k, prune_every = p.prune_every, memory_log = p.memory_log;
+    const double competition = p.competition, capacity = p.capacity, growth = p.growth;
+    const double max_distance = p.max_distance, compact_dead = p.compact_dead;
+    const bool report = p.report;
+    const std::string & mating = p.mating, & reorder = p.reorder, & initial = p.initial,
+                        & compact = p.compact, & prune = p.prune;
+    std::string telemetry_name = p.telemetry;
 
     //per-generation rates
     const double mu_n = theta/double(4*N);
@@ -109,35 +305,26 @@ int main(int argc, char ** argv)
     //takes care of that for us.
     KTfwd::GSLrng_t<KTfwd::GSL_RNG_MT19937> rng(seed);
 
-    //Our genetic map is uniform on the interval (0,1]
-    std::function<double(void)> recmap = std::bind(gsl_rng_uniform,rng.get());
-
-    //This is our population:
-    landscape::poptype pop(N);
+    //This is our population.  Its containers follow memory_placement():
+    landscape::placed_poptype pop(N);
 
-    //Assign random points in space to our diploids.
+    //Assign points in space to our diploids.
     //The geometry is a square (0,0) to (1,1).
-    //We assign 1/2 of diploids to upper left,
+    //By default, we assign 1/2 of diploids to upper left,
     //and 1/2 to lower right of the landscape initially.
-    rtree_type rtree;
-    for(std::size_t i=0; i<N; ++i)
+    //See initial.hpp for the other options.
+    //The rtree is then built from all the points in one pass.
+    std::vector<landscape::csdiploid::value> initial_values;
+    try
     {
-        double x=0.0,y=0.0;
-        if(i<N/2)
-        {
-            //Yes, I am aware that this does not truly
-            //sample uniformly in 2d...
-            x = gsl_ran_flat(rng.get(),0.,0.5);
-            y = gsl_ran_flat(rng.get(),0.5,1.);
-        }
-        else
-        {
-            x = gsl_ran_flat(rng.get(),0.5,1);
-            y = gsl_ran_flat(rng.get(),0.,0.5);
-        }
-        pop.diploids[i].v = landscape::csdiploid::value(std::make_pair(landscape::csdiploid::point(x,y),i));
-        rtree.insert(pop.diploids[i].v);
+        landscape::initial_landscape(initial,rng.get(),pop,initial_values,h);
     }
+    catch(std::exception & e)
+    {
+        std::cerr << "Error: " << e.what() << '\n';
+        exit(1);
+    }
+    rtree_type rtree(index_support<rtree_type>::build(initial_values,p.index));
 
     //pre-allocate space for a good guess as to the total # mutations
     //expected at equilibrium.
@@ -148,20 +335,28 @@ int main(int argc, char ** argv)
      * the "mating radius" and the "dispersal radius"
      */
     rules_type rules(std::move(rtree),radius,dispersal);
+    if(mating == "knn") rules.mating = landscape::mating_mode::knn;
+    if(mating == "deme") rules.mating = landscape::mating_mode::deme;
+    if(mating == "rejection") rules.mating = landscape::mating_mode::rejection;
+    rules.k = k;
+    rules.max_distance = max_distance;
+    rules.sort_mates = p.sort_mates;
+    landscape::index_autotuner autotuner(p.autotune,rules.mating,radius,k);
+    autotuner.verbose = report;
 
     /* Now, we define our recombination,
      * fitness, and mutation models.
      *
-     * Recombination is uniform on the 1/2-open interval [0,1),
-     * which is what the 0 and 1 are in the call below:
+     * These are function objects from models.hpp, so that
+     * the compiler can inline them into fwdpp's loops.
+     *
+     * Recombination is uniform on the 1/2-open interval [0,1):
      */
-    auto recombination_model=std::bind(KTfwd::poisson_xover(),rng.get(),littler,0.,1.,
-                                       std::placeholders::_1,std::placeholders::_2,std::placeholders::_3);
+    landscape::poisson_recombination recombination_model(rng.get(),littler);
     /* Fitness is multiplicative, but with s treated as -s in a square
      * bounded by (0,0) to (0.5,0.5)
      */
-    auto fitness_model = std::bind(spatial_fitness(),std::placeholders::_1,std::placeholders::_2,
-                                   std::placeholders::_3);
+    landscape::spatial_fitness fitness_model;
     //We're going to initialized our generation here...
     unsigned generation=0;
 
@@ -170,32 +365,17 @@ int main(int argc, char ** argv)
      * part of fwdpp.  The mutation type is auto-detected
      * by the compiler to be KTfwd::popgenmut.
      *
-     * We'll cover the details as we move through creating
-     * this object.
-     *
-     * Note that the expressions below are easily modified
+     * Mutation positions are uniform on (0,1], and every
+     * mutation has the same selection coefficient and dominance.
+     * infsites_mutation (models.hpp) is easily modified
      * to allow distributions on s,h, etc., and it is
      * not hard to have variation in mutation and recombination rates,
      * but that is just beyond the scope here.
+     *
+     * The pointer to generation ensures that the origin time
+     * of each mutation is recorded.
      */
-
-    //Mutation positions are uniform on (0,1]
-    auto mutation_positions = [&rng] { return gsl_rng_uniform(rng.get()); };
-    //Every mutation has the same selection coefficient...
-    auto selection_coefficients = [&s] { return s; };
-    //...and the same dominance
-    auto dominance = [&h] {return h;};
-    auto mutation_model = std::bind(KTfwd::infsites(),
-                                    std::placeholders::_1,
-                                    std::placeholders::_2,
-                                    rng.get(),
-                                    std::ref(pop.mut_lookup),
-                                    &generation,//this pointer to generation ensures that origin time of each mutation is recored
-                                    mu_n,
-                                    mu,
-                                    mutation_positions,
-                                    selection_coefficients,
-                                    dominance);
+    auto mutation_model = landscape::make_infsites_mutation(rng.get(),pop.mut_lookup,&generation,mu_n,mu,s,h);
     /* This is the main workhorse.
      * We'll evolve for 10N generations.
      * Each generation, a call to fwdpp's experimental
@@ -209,14 +389,66 @@ int main(int argc, char ** argv)
      * removed, but that is optional--fwdpp has a few variants of that
      * function
      */
+    /* With density regulation, the local density of each parent
+     * modifies its fitness (see density.hpp), and the next generation's
+     * size is Poisson with mean equal to the sum of those modifiers.
+     */
+    landscape::local_density density(competition > 0. ? competition : 1.);
+    landscape::spatial_sorter<decltype(pop.diploids)> sorter(reorder == "hilbert" ? landscape::curve_type::hilbert
+            : landscape::curve_type::morton);
+    landscape::compaction_schedule compaction(compact_dead);
+    landscape::fixation_schedule fixations(prune_every);
+
+    //Live telemetry (see telemetry.hpp).  The time spent in each phase
+    //is only measured if it is published.
+    std::unique_ptr<landscape::telemetry_writer> telemetry;
+    if(!telemetry_name.empty())
+    {
+        if(telemetry_name == "auto") telemetry_name = std::to_string(getpid());
+        try
+        {
+            telemetry.reset(new landscape::telemetry_writer("landscape." + telemetry_name));
+        }
+        catch(std::exception & e)
+        {
+            std::cerr << "Error: " << e.what() << '\n';
+            exit(1);
+        }
+    }
+    landscape::telemetry_values progress;
+    progress.generations = 10*N;
+    auto phase_start = std::chrono::steady_clock::now(), window_start = phase_start;
+    unsigned window_generation = 0;
+    auto lap = [&phase_start]() {
+        auto now = std::chrono::steady_clock::now();
+        std::chrono::duration<double> elapsed = now - phase_start;
+        phase_start = now;
+        return elapsed.count();
+    };
+
+    unsigned N_curr = N;
     for( ; generation < 10*N ; ++generation )
     {
+        if(telemetry) progress.seconds_other += lap();
+        unsigned N_next = N_curr;
+        if(competition > 0.)
+        {
+            density.compute(pop.diploids);
+            N_next = gsl_ran_poisson(rng.get(),landscape::beverton_holt(density,growth,capacity,rules.fitness_modifiers));
+            if(!N_next)
+            {
+                std::cerr << "Population went extinct in generation " << generation << '\n';
+                telemetry.reset();
+                exit(0);
+            }
+        }
         double wbar = KTfwd::experimental::sample_diploid(rng.get(),
                       pop.gametes,
                       pop.diploids,
                       pop.mutations,
                       pop.mcounts,
-                      N, //Population size will be constant.  If changing, we also pass in the next size
+                      N_curr,
+                      N_next, //Population size is constant unless there is density regulation
                       mu_n+mu, //TOTAL mutation rate = neutral + selected mutation rates
                       mutation_model,
                       recombination_model,
@@ -225,43 +457,135 @@ int main(int argc, char ** argv)
                       0,//This is probability(selfing). It defaults to 0, but we need to pass it
                       //so that we can pass our "rules" along on the next line
                       rules);
+        if(telemetry) progress.seconds_sample += lap();
         //Take any fixed variants, transfer them out of population and into fixation time containers
-        KTfwd::update_mutations(pop.mutations,pop.fixations,pop.fixation_times,pop.mut_lookup,pop.mcounts,generation,2*N);
+        if(prune == "always")
+        {
+            KTfwd::update_mutations(pop.mutations,pop.fixations,pop.fixation_times,pop.mut_lookup,pop.mcounts,generation,2*N_next);
+        }
+        else fixations(pop,generation,2*N_next);
+        if(telemetry) progress.seconds_update += lap();
+        N_curr = N_next;
+        if(compact != "never" && compaction.check(pop,generation)) fixations.reset();
+        if(memory_log && (generation+1)%memory_log==0)
+        {
+            std::cerr << "memory: generation = " << generation+1 << ", "
+                      << landscape::memory_usage(pop,index_support<rtree_type>::bytes()) << '\n';
+        }
+        if(reorder != "none") sorter(pop.diploids,rules);
+        index_support<rtree_type>::tune(autotuner,generation,pop.diploids,rules.offspring_rtree);
+        //The offspring rtree indexes the diploids we just made
+        if(stats_params.grid && stats_every && (generation+1)%stats_every==0)
+        {
+            landscape::write_spatial_stats(std::cout,generation+1,
+                                           landscape::spatial_summaries(pop,rules.offspring_rtree,stats_params),
+                                           pop.mutations,stats_params);
+        }
+        if(telemetry)
+        {
+            progress.seconds_other += lap();
+            progress.generation = generation+1;
+            progress.N = N_curr;
+            progress.wbar = wbar;
+            progress.mutations = pop.mutations.size();
+            progress.gametes = pop.gametes.size();
+            progress.fixations = pop.fixations.size();
+            //The rate, and what memory_usage() finds, about once a second
+            std::chrono::duration<double> window = phase_start - window_start;
+            if(window.count() >= 1.)
+            {
+                progress.rate = double(generation+1 - window_generation)/window.count();
+                auto m = landscape::memory_usage(pop,index_support<rtree_type>::bytes());
+                progress.memory = m.total();
+                progress.live_mutations = m.live_mutations;
+                progress.live_gametes = m.live_gametes;
+                window_start = phase_start;
+                window_generation = generation+1;
+                progress.seconds_other += lap();
+            }
+            telemetry->publish(progress,std::uint64_t(std::chrono::duration_cast<std::chrono::milliseconds>(
+                                   std::chrono::system_clock::now().time_since_epoch()).count()));
+        }
     }
-    if(!format)
+    if(report)
+    {
+        std::cerr << "picks = " << rules.npicks << ", selfs = " << rules.nselfs
+                  << ", forced selfs = " << rules.nforced_selfs
+                  << ", selfing rate = " << double(rules.nselfs)/double(rules.npicks) << '\n';
+        if(rules.nrejection_tries || rules.nrejection_fallbacks)
+        {
+            std::cerr << "rejection tries per pick = " << double(rules.nrejection_tries)/double(rules.npicks)
+                      << ", fallbacks = " << rules.nrejection_fallbacks << '\n';
+        }
+        if(autotuner.active())
+        {
+            std::cerr << "index = " << index_support<rtree_type>::name(rules.offspring_rtree)
+                      << ", autotune checks = " << autotuner.nchecks << ", switches = " << autotuner.nswitches
+                      << ", seconds = " << autotuner.seconds << ", neighbours per query = " << autotuner.neighbours << '\n';
+        }
+        if(prune != "always")
+        {
+            std::cerr << "update_mutations calls = " << fixations.nfull << ", generations without = " << fixations.nskipped << '\n';
+        }
+        if(landscape::memory_placement().active())
+        {
+            const auto & placed = landscape::placement_stats();
+            std::cerr << "numa = " << p.numa << ", huge_pages = " << p.huge_pages
+                      << ", placed bytes = " << placed.placed_bytes << ", hugetlb bytes = " << placed.hugetlb_bytes
+                      << ", mbind failures = " << placed.mbind_failures
+                      << ", madvise failures = " << placed.madvise_failures << '\n';
+        }
+    }
+    if(memory_log)
+    {
+        std::cerr << "memory: compactions = " << compaction.ncompactions << '\n';
+    }
+    if(stats_params.grid)
+    {
+        if(!stats_every || generation%stats_every)
+        {
+            landscape::write_spatial_stats(std::cout,generation,
+                                           landscape::spatial_summaries(pop,rules.offspring_rtree,stats_params),
+                                           pop.mutations,stats_params);
+        }
+    }
+    else if(!format)
     {
         //At this point, we would do some analysis...
         //Here, we'll print out each diploid, and
         //the position + s for each mutation on each chromosome,
         //plus its coordinate.  Output will be "tidy",
         //e.g. ready for dplyr.
+        //Diploids are listed in birth order, which is
+        //not the order they are stored in if reorder is used.
         std::cout << "dip x y chrom pos s\n";
-        for(std::size_t i=0; i<pop.diploids.size(); ++i)
+        for(std::size_t b=0; b<pop.diploids.size(); ++b)
         {
+            const std::size_t i = rules.storage_index.empty() ? b : rules.storage_index[b];
             auto x = pop.diploids[i].v.first.get<0>();
             auto y = pop.diploids[i].v.first.get<1>();
             if(pop.gametes[pop.diploids[i].first].smutations.empty())
             {
-                std::cout << i << ' ' << x << ' ' << y << " 0 " <<"NA NA" << '\n';
+                std::cout << b << ' ' << x << ' ' << y << " 0 " <<"NA NA" << '\n';
             }
             else
             {
                 for(const auto & m : pop.gametes[pop.diploids[i].first].smutations)
                 {
-                    std::cout << i << ' ' << x << ' ' << y << " 0 "
+                    std::cout << b << ' ' << x << ' ' << y << " 0 "
                               << pop.mutations[m].pos << ' '
                               << pop.mutations[m].s << '\n';
                 }
             }
             if(pop.gametes[pop.diploids[i].second].smutations.empty())
             {
-                std::cout << i << ' ' << x << ' ' << y << " 1 " << "NA NA" << '\n';
+                std::cout << b << ' ' << x << ' ' << y << " 1 " << "NA NA" << '\n';
             }
             else
             {
                 for(const auto & m : pop.gametes[pop.diploids[i].second].smutations)
                 {
-                    std::cout << i << ' ' << x << ' ' << y << " 1 "
+                    std::cout << b << ' ' << x << ' ' << y << " 1 "
                               << pop.mutations[m].pos << ' '
                               << pop.mutations[m].s << '\n';
                 }
@@ -276,23 +600,28 @@ int main(int argc, char ** argv)
          * from the population
          */
         std::vector<unsigned> diploids2sample;
-        if( format < N )
+        if( format < N_curr )
         {
             for(unsigned i=0; i<format; ++i)
             {
-                auto ind = unsigned(gsl_ran_flat(rng.get(),0.0,double(N)));
+                auto ind = unsigned(gsl_ran_flat(rng.get(),0.0,double(N_curr)));
                 while(find(diploids2sample.begin(),diploids2sample.end(),ind)!=diploids2sample.end())
                 {
-                    ind = unsigned(gsl_ran_flat(rng.get(),0.0,double(N)));
+                    ind = unsigned(gsl_ran_flat(rng.get(),0.0,double(N_curr)));
                 }
                 diploids2sample.push_back(ind);
             }
         } else
         {
-            diploids2sample.resize(N);
+            diploids2sample.resize(N_curr);
             unsigned i=0;
             std::generate(diploids2sample.begin(),diploids2sample.end(),[&i] {return i++;});
         }
+        //The above are birth orders.  Find where they are stored.
+        if(!rules.storage_index.empty())
+        {
+            for(auto & d : diploids2sample) d = unsigned(rules.storage_index[d]);
+        }
 
         auto popsample = KTfwd::sample_separate(pop,diploids2sample,true);//true = do not include variants fixed in the sample
         /*
@@ -0,0 +1,142 @@
+/*
+ * The landscape model of wflandscape.cc, on a line
+ * (a river, a coastline...) instead of a square.
+ * The spatial index is a sorted array instead of an rtree.
+ * See linerules.hpp.
+ */
+#include "simtypes.hpp"
+#include "linerules.hpp"
+#include "options.hpp"
+#include "models.hpp"
+#include <cassert> //fwdpp has this missing in one of its headers...
+#include <cstdlib>
+#include <iostream>
+#include <fwdpp/diploid.hh>
+#include <fwdpp/experimental/sample_diploid.hpp>
+#include <fwdpp/sugar/infsites.hpp>
+#include <fwdpp/sugar/GSLrng_t.hpp>
+#include <gsl/gsl_randist.h>
+
+using rules_type = landscape::WFLandscapeRules<landscape::line_index>;
+
+int main(int argc, char ** argv)
+{
+    if(argc<10)
+    {
+        std::cerr << "Incorrect number of arguments.\n"
+                  << "Usage:\n"
+                  << argv[0] << ' '
+                  << "N "
+                  << "theta "
+                  << "rho "
+                  << "s "
+                  << "h "
+                  << "mutrate_to_selected "
+                  << "radius "
+                  << "dispersal "
+                  << "seed\n"
+                  << "\n"
+                  << "The landscape is the interval [0,1].\n"
+                  << "Output is the list of diploids + selected mutations.\n"
+                  << "\n"
+                  << "Optional arguments, given as name=value after seed:\n"
+                  << "mating = radius or knn (default radius)\n"
+                  << "k = # nearest neighbours for knn mating (default 8)\n"
+                  << "max_distance = if > 0, knn mates must be within this distance\n"
+                  << "report = 1 means print selfing statistics to stderr\n";
+        exit(0);
+    }
+    int argn = 1;
+    const unsigned N = atoi(argv[argn++]);
+    const double theta = atof(argv[argn++]);
+    const double rho = atof(argv[argn++]);
+    const double s = atof(argv[argn++]);
+    const double h = atof(argv[argn++]);
+    const double mu = atof(argv[argn++]);
+    const double radius = atof(argv[argn++]);
+    const double dispersal = atof(argv[argn++]);
+    const unsigned seed = atoi(argv[argn++]);
+
+    landscape::options opts(argc,argv,argn);
+    const std::string mating = opts.get("mating","radius");
+    const unsigned k = opts.get("k",8u);
+    const double max_distance = opts.get("max_distance",0.);
+    const bool report = opts.get("report",0u);
+    opts.check();
+    if(mating != "radius" && mating != "knn")
+    {
+        std::cerr << "Error: mating must be radius or knn\n";
+        exit(1);
+    }
+
+    const double mu_n = theta/double(4*N);
+    const double littler = rho/double(4*N);
+
+    KTfwd::GSLrng_t<KTfwd::GSL_RNG_MT19937> rng(seed);
+
+    landscape::poptype1d pop(N);
+
+    //Diploids start out uniform on the line
+    landscape::line_index index;
+    for(std::size_t i=0; i<N; ++i)
+    {
+        double x = gsl_ran_flat(rng.get(),0.,1.);
+        pop.diploids[i].v = landscape::csdiploid1d::value(std::make_pair(landscape::csdiploid1d::point(x),i));
+        index.insert(pop.diploids[i].v);
+    }
+    pop.mutations.reserve(size_t(std::ceil(std::log(2*N)*theta+0.667*theta)));
+
+    rules_type rules(std::move(index),radius,dispersal);
+    if(mating == "knn") rules.mating = landscape::mating_mode::knn;
+    rules.k = k;
+    rules.max_distance = max_distance;
+
+    landscape::poisson_recombination recombination_model(rng.get(),littler);
+    //s is treated as -s on the left half of the line
+    landscape::spatial_fitness fitness_model;
+    unsigned generation=0;
+    auto mutation_model = landscape::make_infsites_mutation(rng.get(),pop.mut_lookup,&generation,mu_n,mu,s,h);
+    for( ; generation < 10*N ; ++generation )
+    {
+        KTfwd::experimental::sample_diploid(rng.get(),
+                                            pop.gametes,
+                                            pop.diploids,
+                                            pop.mutations,
+                                            pop.mcounts,
+                                            N,
+                                            mu_n+mu,
+                                            mutation_model,
+                                            recombination_model,
+                                            fitness_model,
+                                            pop.neutral,pop.selected,
+                                            0,
+                                            rules);
+        KTfwd::update_mutations(pop.mutations,pop.fixations,pop.fixation_times,pop.mut_lookup,pop.mcounts,generation,2*N);
+    }
+    if(report)
+    {
+        std::cerr << "picks = " << rules.npicks << ", selfs = " << rules.nselfs
+                  << ", forced selfs = " << rules.nforced_selfs
+                  << ", selfing rate = " << double(rules.nselfs)/double(rules.npicks) << '\n';
+    }
+    std::cout << "dip x chrom pos s\n";
+    for(std::size_t i=0; i<pop.diploids.size(); ++i)
+    {
+        auto x = pop.diploids[i].v.first.get<0>();
+        unsigned chrom = 0;
+        for(const auto g : {pop.diploids[i].first,pop.diploids[i].second})
+        {
+            if(pop.gametes[g].smutations.empty())
+            {
+                std::cout << i << ' ' << x << ' ' << chrom << " NA NA" << '\n';
+            }
+            for(const auto & m : pop.gametes[g].smutations)
+            {
+                std::cout << i << ' ' << x << ' ' << chrom << ' '
+                          << pop.mutations[m].pos << ' '
+                          << pop.mutations[m].s << '\n';
+            }
+            ++chrom;
+        }
+    }
+}
@@ -0,0 +1,185 @@
+/*
+ * Many replicates of the wflandscape model in one process.
+ *
+ * Replicates are scheduled across a work-stealing thread pool
+ * (workpool.hpp).  Each thread keeps one simulation object
+ * (simulation.hpp) and re-uses it for all the replicates it runs,
+ * and all results go to one indexed binary file (batchio.hpp),
+ * which can be read with batchdump.
+ */
+#include "simtypes.hpp"
+#include "simulation.hpp"
+#include "batchio.hpp"
+#include "workpool.hpp"
+#include "options.hpp"
+#include <cassert> //fwdpp has this missing in one of its headers...
+#include <cstdlib>
+#include <atomic>
+#include <chrono>
+#include <exception>
+#include <mutex>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <boost/geometry/index/rtree.hpp>
+
+namespace bgi = boost::geometry::index;
+
+using rtree_type = bgi::rtree< landscape::csdiploid::value, bgi::quadratic<16> >;
+using simulation_type = landscape::landscape_simulation<rtree_type>;
+
+struct table_row
+{
+    landscape::landscape_params params;
+    unsigned seed,nreps;
+};
+
+//Whitespace-separated rows of N theta rho s h mutrate_to_selected radius dispersal seed nreps.
+//Blank lines and lines starting with # are skipped.
+std::vector<table_row> read_table(const char * filename)
+{
+    std::ifstream in(filename);
+    if(!in)
+    {
+        std::cerr << "Error: could not open " << filename << '\n';
+        exit(1);
+    }
+    std::vector<table_row> rows;
+    std::string line;
+    unsigned lineno = 0;
+    while(std::getline(in,line))
+    {
+        ++lineno;
+        auto first = line.find_first_not_of(" \t\r");
+        if(first == std::string::npos || line[first] == '#') continue;
+        std::istringstream fields(line);
+        table_row r;
+        auto & p = r.params;
+        if(!(fields >> p.N >> p.theta >> p.rho >> p.s >> p.h >> p.mu >> p.radius >> p.dispersal >> r.seed >> r.nreps)
+                || !p.N)
+        {
+            std::cerr << "Error: could not parse line " << lineno << " of " << filename << '\n';
+            exit(1);
+        }
+        rows.push_back(r);
+    }
+    return rows;
+}
+
+int main(int argc, char ** argv)
+{
+    if(argc<3)
+    {
+        std::cerr << "Incorrect number of arguments.\n"
+                  << "Usage:\n"
+                  << argv[0] << ' '
+                  << "table "
+                  << "outfile\n"
+                  << "\n"
+                  << "Each line of table is the parameters of wflandscape + the # of replicates:\n"
+                  << "N theta rho s h mutrate_to_selected radius dispersal seed nreps\n"
+                  << "Replicate seeds are derived from seed.  The seed of each replicate is\n"
+                  << "stored in outfile, so any replicate can be re-run with wflandscape.\n"
+                  << "Results go to the binary file outfile.  Use batchdump to read it.\n"
+                  << "\n"
+                  << "Optional arguments, given as name=value after outfile:\n"
+                  << "threads = # threads (default: # cores)\n"
+                  << "generations = # generations to run (default 10N)\n"
+                  << "mating (radius, knn, deme or rejection), k, max_distance, initial: as for wflandscape\n"
+                  << "report = 1 means print timing to stderr\n";
+        exit(0);
+    }
+    const auto rows = read_table(argv[1]);
+    const std::string outfile(argv[2]);
+
+    landscape::options opts(argc,argv,3);
+    const unsigned nthreads = opts.get("threads",std::max(1u,std::thread::hardware_concurrency()));
+    const unsigned generations = opts.get("generations",0u);
+    const std::string mating = opts.get("mating","radius");
+    const unsigned k = opts.get("k",8u);
+    const double max_distance = opts.get("max_distance",0.);
+    const bool report = opts.get("report",0u);
+    const std::string initial = opts.get("initial","quadrants");
+    opts.check();
+    if(mating != "radius" && mating != "knn" && mating != "deme" && mating != "rejection")
+    {
+        std::cerr << "Error: mating must be radius, knn, deme or rejection\n";
+        exit(1);
+    }
+
+    //One task per replicate
+    struct task
+    {
+        std::uint32_t row,rep,seed;
+    };
+    std::vector<task> tasks;
+    for(std::uint32_t i = 0 ; i < rows.size() ; ++i)
+    {
+        for(std::uint32_t j = 0 ; j < rows[i].nreps ; ++j)
+        {
+            tasks.push_back(task{i,j,landscape::replicate_seed(rows[i].seed,j)});
+        }
+    }
+    //A W-F replicate costs ~ 10N generations x N offspring, so
+    //deal the biggest ones first.
+    std::vector<std::size_t> order(tasks.size());
+    for(std::size_t i = 0 ; i < order.size() ; ++i) order[i] = i;
+    auto cost = [&](std::size_t t) {
+        const auto & p = rows[tasks[t].row].params;
+        return double(p.N)*double(generations ? generations : 10*p.N);
+    };
+    std::stable_sort(order.begin(),order.end(),[&cost](std::size_t a, std::size_t b) {
+        return cost(a) > cost(b);
+    });
+
+    landscape::work_stealing_pool pool(nthreads);
+    std::vector<simulation_type> replicates(pool.size());
+    std::vector<std::vector<char>> records(pool.size());
+    std::mutex output_mutex;
+    //A task that throws stops the others from starting, and the first
+    //exception is rethrown once the threads are done.
+    std::atomic<bool> failed(false);
+    std::exception_ptr error;
+    try
+    {
+        landscape::batch_writer writer(outfile);
+        auto start = std::chrono::steady_clock::now();
+        pool.run(order,[&](std::size_t w, std::size_t t) {
+            if(failed) return;
+            auto p = rows[tasks[t].row].params;
+            if(mating == "knn") p.mating = landscape::mating_mode::knn;
+            if(mating == "deme") p.mating = landscape::mating_mode::deme;
+            if(mating == "rejection") p.mating = landscape::mating_mode::rejection;
+            p.k = k;
+            p.max_distance = max_distance;
+            p.initial = initial;
+            try
+            {
+                replicates[w].reset(p,tasks[t].seed);
+                replicates[w].step(generations ? generations : 10*p.N);
+                landscape::encode_replicate(records[w],replicates[w].population(),
+                                            replicates[w].mating_rules().storage_index);
+                std::lock_guard<std::mutex> lock(output_mutex);
+                if(!failed) writer.write(tasks[t].row,tasks[t].rep,tasks[t].seed,records[w]);
+            }
+            catch(...)
+            {
+                std::lock_guard<std::mutex> lock(output_mutex);
+                if(!failed.exchange(true)) error = std::current_exception();
+            }
+        });
+        if(error) std::rethrow_exception(error);
+        writer.close();
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        if(report)
+        {
+            std::cerr << "replicates = " << tasks.size() << ", threads = " << pool.size()
+                      << ", seconds = " << elapsed.count() << '\n';
+        }
+    }
+    catch(std::exception & e)
+    {
+        std::cerr << "Error: " << e.what() << '\n';
+        exit(1);
+    }
+}
@@ -0,0 +1,88 @@
+/*
+ * Example of using the simulation object in simulation.hpp:
+ * run a burn-in once, then run many continuations branched
+ * from it, possibly with new parameters.
+ */
+#include "simulation.hpp"
+#include "options.hpp"
+#include <cassert> //fwdpp has this missing in one of its headers...
+#include <cstdlib>
+#include <iostream>
+
+int main(int argc, char ** argv)
+{
+    if(argc<13)
+    {
+        std::cerr << "Incorrect number of arguments.\n"
+                  << "Usage:\n"
+                  << argv[0] << ' '
+                  << "N "
+                  << "theta "
+                  << "rho "
+                  << "s "
+                  << "h "
+                  << "mutrate_to_selected "
+                  << "radius "
+                  << "dispersal "
+                  << "seed "
+                  << "burnin "
+                  << "nbranches "
+                  << "generations\n"
+                  << "\n"
+                  << "Runs burnin generations, then nbranches continuations of generations each.\n"
+                  << "Each branch has its own seed, derived from seed.\n"
+                  << "Output is one line per branch: branch, mean fitness, # selected mutations\n"
+                  << "segregating, and # fixations since the end of the burn-in.\n"
+                  << "\n"
+                  << "Optional arguments, given as name=value after generations,\n"
+                  << "change the parameters of the branches:\n"
+                  << "s, h, mutrate_to_selected, radius, dispersal\n";
+        exit(0);
+    }
+    int argn = 1;
+    landscape::landscape_params p;
+    p.N = atoi(argv[argn++]);
+    p.theta = atof(argv[argn++]);
+    p.rho = atof(argv[argn++]);
+    p.s = atof(argv[argn++]);
+    p.h = atof(argv[argn++]);
+    p.mu = atof(argv[argn++]);
+    p.radius = atof(argv[argn++]);
+    p.dispersal = atof(argv[argn++]);
+    const unsigned seed = atoi(argv[argn++]);
+    const unsigned burnin = atoi(argv[argn++]);
+    const unsigned nbranches = atoi(argv[argn++]);
+    const unsigned generations = atoi(argv[argn++]);
+
+    landscape::options opts(argc,argv,argn);
+    landscape::landscape_params q(p);
+    q.s = opts.get("s",p.s);
+    q.h = opts.get("h",p.h);
+    q.mu = opts.get("mutrate_to_selected",p.mu);
+    q.radius = opts.get("radius",p.radius);
+    q.dispersal = opts.get("dispersal",p.dispersal);
+    opts.check();
+
+    landscape::landscape_simulation<> burnt(p,seed);
+    burnt.step(burnin);
+    burnt.params() = q;
+    const auto nfixed = burnt.population().fixations.size();
+
+    std::cout << "branch wbar segregating fixations\n";
+    for(unsigned b = 0 ; b < nbranches ; ++b)
+    {
+        auto sim = burnt.branch(landscape::replicate_seed(seed,b));
+        sim.step(generations);
+        double wbar = 0.;
+        for(const auto w : sim.fitnesses()) wbar += w;
+        wbar /= double(sim.diploids().size);
+        unsigned segregating = 0;
+        const auto & pop = sim.population();
+        for(std::size_t i = 0 ; i < pop.mutations.size() ; ++i)
+        {
+            if(pop.mcounts[i] && !pop.mutations[i].neutral) ++segregating;
+        }
+        std::cout << b << ' ' << wbar << ' ' << segregating << ' '
+                  << pop.fixations.size() - nfixed << '\n';
+    }
+}
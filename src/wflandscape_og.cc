@@ -0,0 +1,147 @@
+/*
+ * Landscape model with overlapping generations in continuous time.
+ * Births and deaths happen one at a time, and the rtree of living
+ * diploids is updated incrementally rather than rebuilt.
+ * See ogengine.hpp for the model.
+ */
+#include "simtypes.hpp"
+#include "ogengine.hpp"
+#include "models.hpp"
+#include "options.hpp"
+#include "initial.hpp"
+#include <cassert> //fwdpp has this missing in one of its headers...
+#include <cstdlib>
+#include <chrono>
+#include <iostream>
+#include <fwdpp/diploid.hh>
+#include <fwdpp/sugar/infsites.hpp>
+#include <fwdpp/sugar/GSLrng_t.hpp>
+#include <gsl/gsl_randist.h>
+#include <boost/geometry/index/rtree.hpp>
+
+namespace bg = boost::geometry;
+namespace bgi = boost::geometry::index;
+
+//typedefs to simplify life
+using rtree_type = bgi::rtree< landscape::csdiploid::value, bgi::quadratic<16> >;
+using engine_type = landscape::OGLandscapeEngine<rtree_type>;
+
+int main(int argc, char ** argv)
+{
+    if(argc<11)
+    {
+        std::cerr << "Incorrect number of arguments.\n"
+                  << "Usage:\n"
+                  << argv[0] << ' '
+                  << "K "
+                  << "theta "
+                  << "rho "
+                  << "s "
+                  << "h "
+                  << "mutrate_to_selected "
+                  << "radius "
+                  << "dispersal "
+                  << "seed "
+                  << "time\n"
+                  << "\n"
+                  << "K is the carrying capacity and the initial population size.\n"
+                  << "theta, rho are 4Ku, 4Kr.\n"
+                  << "time is how long to run, in units of expected lifetimes.\n"
+                  << "Output is the list of living diploids + selected mutations.\n"
+                  << "\n"
+                  << "Optional arguments, given as name=value after time:\n"
+                  << "report = 1 means print # events and events per second to stderr\n"
+                  << "initial = initial landscape: quadrants (default), uniform, clustered:k:sigma,\n"
+                  << "          raster:filename or file:filename (see initial.hpp)\n";
+        exit(0);
+    }
+    int argn = 1;
+    const unsigned K = atoi(argv[argn++]);
+    const double theta = atof(argv[argn++]);
+    const double rho = atof(argv[argn++]);
+    const double s = atof(argv[argn++]);
+    const double h = atof(argv[argn++]);
+    const double mu = atof(argv[argn++]);
+    const double radius = atof(argv[argn++]);
+    const double dispersal = atof(argv[argn++]);
+    const unsigned seed = atoi(argv[argn++]);
+    const double T = atof(argv[argn++]);
+
+    landscape::options opts(argc,argv,argn);
+    const bool report = opts.get("report",0u);
+    const std::string initial = opts.get("initial","quadrants");
+    opts.check();
+
+    //per-birth rates
+    const double mu_n = theta/double(4*K);
+    const double littler = rho/double(4*K);
+
+    KTfwd::GSLrng_t<KTfwd::GSL_RNG_MT19937> rng(seed);
+
+    landscape::poptype pop(K);
+
+    //Assign points in space to our diploids.
+    //The geometry is a square (0,0) to (1,1).
+    //By default, we assign 1/2 of diploids to upper left,
+    //and 1/2 to lower right of the landscape initially.
+    //See initial.hpp for the other options.
+    //The rtree is then built from all the points in one pass.
+    std::vector<landscape::csdiploid::value> initial_values;
+    try
+    {
+        landscape::initial_landscape(initial,rng.get(),pop,initial_values,h);
+    }
+    catch(std::exception & e)
+    {
+        std::cerr << "Error: " << e.what() << '\n';
+        exit(1);
+    }
+    rtree_type rtree(initial_values.begin(),initial_values.end());
+    pop.mutations.reserve(size_t(std::ceil(std::log(2*K)*theta+0.667*theta)));
+
+    landscape::poisson_recombination recombination_model(rng.get(),littler);
+    landscape::spatial_fitness fitness_model;
+    //Here, the "generation" is the integer part of the time
+    unsigned generation=0;
+    auto mutation_model = landscape::make_infsites_mutation(rng.get(),pop.mut_lookup,&generation,mu_n,mu,s,h);
+
+    engine_type engine(std::move(rtree),radius,dispersal,double(K));
+    engine.init(pop,fitness_model);
+    auto start = std::chrono::steady_clock::now();
+    engine.run(rng.get(),pop,T,generation,mu_n+mu,mutation_model,recombination_model,fitness_model);
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    if(report)
+    {
+        auto nevents = engine.nbirths + engine.ndeaths;
+        std::cerr << "events = " << nevents << ", births = " << engine.nbirths
+                  << ", deaths = " << engine.ndeaths << ", N = " << engine.size()
+                  << ", seconds = " << elapsed.count()
+                  << ", events/second = " << double(nevents)/elapsed.count() << '\n';
+    }
+    //Make mutation counts current before output
+    engine.bookkeeping(pop,generation);
+
+    //Same "tidy" output as wflandscape.cc, for living diploids only.
+    //The dip column is the slot in pop.diploids.
+    std::cout << "dip x y chrom pos s\n";
+    for(const auto i : engine.living)
+    {
+        auto x = pop.diploids[i].v.first.get<0>();
+        auto y = pop.diploids[i].v.first.get<1>();
+        unsigned chrom = 0;
+        for(const auto g : {pop.diploids[i].first,pop.diploids[i].second})
+        {
+            if(pop.gametes[g].smutations.empty())
+            {
+                std::cout << i << ' ' << x << ' ' << y << ' ' << chrom << " NA NA" << '\n';
+            }
+            for(const auto & m : pop.gametes[g].smutations)
+            {
+                std::cout << i << ' ' << x << ' ' << y << ' ' << chrom << ' '
+                          << pop.mutations[m].pos << ' '
+                          << pop.mutations[m].s << '\n';
+            }
+            ++chrom;
+        }
+    }
+}
@@ -5,12 +5,35 @@
  * being able to use fwdpp "as is".  Overlapping generations
  * will require some custom code b/c fwdpp doesn't currently
  * provide support for such life cycles
+ *
+ * By default, the models are the function objects in models.hpp,
+ * and the mating mode is a compile-time policy of the rules
+ * (policies.hpp).  If compiled with -DLANDSCAPE_BOUND_MODELS,
+ * the models are std::bind expressions and the mating mode
+ * is chosen at run time, which is how things used to be done.
+ * The Makefile builds both, as wflandscape_timing and
+ * wflandscape_timing_bound, and their output is the same.
+ *
+ * The spatial index is chosen at run time (see autotune.hpp), and
+ * can be re-chosen every few generations by the autotuner.  If possible
+ * mates are sorted (sort_mates=1, the default with reorder or autotune),
+ * that does not change the output either.
  */
 #include "simtypes.hpp"
 #include "wfrules.hpp"
+#include "models.hpp"
+#include "options.hpp"
+#include "initial.hpp"
+#include "reorder.hpp"
+#include "perfcounters.hpp"
+#include "placement.hpp"
+#include "autotune.hpp"
 #include <cassert> //fwdpp has this missing in one of its headers...
 #include <cstdlib>
+#include <chrono>
+#ifdef LANDSCAPE_BOUND_MODELS
 #include <functional>
+#endif
 #include <iostream>
 #include <fwdpp/diploid.hh>  //Main fwdpp library header
 #include <fwdpp/experimental/sample_diploid.hpp> //"Experimental" version of WF sampling function
@@ -26,47 +49,29 @@ namespace bgi = boost::geometry::index;
 
 
 //typedefs to simplify life
-using rtree_type = bgi::rtree< landscape::csdiploid::value, bgi::quadratic<64> >;
-using rules_type = landscape::WFLandscapeRules<rtree_type>;
+using rtree_type = landscape::adaptive_index<landscape::csdiploid::value>;
 
-//Arbitrary model for fitness.
-//Treat s as -s in the
-//lower left quandrant of the landscape,
-//otherwise as s.
-//Fitness is multiplicative across sites.
-struct spatial_fitness
+struct timing_params
 {
-    /* This function makes a spatial fitness object
-     * behave as a function.
-     * Note: if we had an additional landscape that reflected
-     * how the landscape modified genetic values of fitness,
-     * we could bind it here.
-     */
-    inline double operator()(const landscape::csdiploid & dip,
-                             const std::vector<KTfwd::gamete> & gametes,
-                             const std::vector<KTfwd::popgenmut> & mutations) const
-    {
-        double x = boost::geometry::get<0>(dip.v.first);
-        double y = boost::geometry::get<1>(dip.v.first);
-        KTfwd::site_dependent_fitness s;
-        double geographic_factor = 1.0;
-        if(x<=0.5 && y <= 0.5) geographic_factor = -1.0;
-
-        return std::max(0.0,
-                        s(dip,gametes,mutations,
-        [&geographic_factor](double & w,const KTfwd::popgenmut & m) {
-            w *= (1.0 + geographic_factor*2.0*m.s);
-        },
-        [&geographic_factor](double & w,const KTfwd::popgenmut & m) {
-            w *= (1.0 + geographic_factor*m.h*m.s);
-        },
-        1.0));
-    }
+    unsigned N;
+    double theta,rho,s,h,mu,radius,dispersal;
+    unsigned seed,format;
+    std::string mating;
+    unsigned k;
+    double max_distance;
+    std::string reorder,initial;
+    std::string numa,huge_pages;
+    landscape::index_config index;
+    unsigned autotune;
+    bool sort_mates;
 };
 
+template<typename mating_policy>
+void simulate(const timing_params & p);
+
 int main(int argc, char ** argv)
 {
-    if(argc!=11)
+    if(argc<11)
     {
         std::cerr << "Incorrect number of arguments.\n"
                   << "Usage:\n"
@@ -85,20 +90,98 @@ int main(int argc, char ** argv)
                   << "Note: format = 0 means list of diploids + selected mutations\n"
                   << "format = nsam > 0  = ms-style output of nsam diploids + their geographic locations\n"
 				  << "format = N = output info for whole population\n"
-				  << "format > N = bad bad bad\n";
+				  << "format > N = bad bad bad\n"
+                  << "\n"
+                  << "Optional arguments, given as name=value after format:\n"
+                  << "mating = radius, knn, deme or rejection (default radius)\n"
+                  << "k = # nearest neighbours for knn mating\n"
+                  << "max_distance = if > 0, knn mates must be within this distance\n"
+                  << "reorder = none, morton or hilbert: sort diploids in memory each generation\n"
+                  << "initial = initial landscape, as for wflandscape\n"
+                  << "numa = none, interleave or partitioned: NUMA placement of the population (default none)\n"
+                  << "huge_pages = none, transparent or explicit (default none)\n"
+                  << "numa_parts = # pieces for numa=partitioned (default: # NUMA nodes)\n"
+                  << "index = quadratic16, quadratic64, rstar16, linear16 or grid: the spatial index (default quadratic64)\n"
+                  << "index_build = insert or bulk: add offspring to the index as they are born, or pack it when done (default insert)\n"
+                  << "cell_size = grid cell size (default: the larger of radius and 1/sqrt(N))\n"
+                  << "autotune = K > 0 means time every index every K generations, and switch to the fastest (default 0)\n"
+                  << "sort_mates = 1 means sort possible mates by birth order, so that the output does not depend on the\n"
+                  << "             index or on reorder (default: 1 with reorder or autotune, else 0)\n"
+                  << "\n"
+                  << "Time spent in the generation loop, cache misses (if the counter is available),\n"
+                  << "and selfing statistics are printed to stderr.\n";
         exit(0);
     }
     int argn = 1;
-    const unsigned N = atoi(argv[argn++]);
-    const double theta = atof(argv[argn++]);
-    const double rho = atof(argv[argn++]);
-    const double s = atof(argv[argn++]);       //selection coefficient
-    const double h = atof(argv[argn++]);       //dominance.  Fitnesses will be 1,1+sh,1+2s, so h=1=additive.
-    const double mu = atof(argv[argn++]);      //mutation rate to selected variants
-    const double radius = atof(argv[argn++]);  //Radius in which to search for mates.
-    const double dispersal = atof(argv[argn++]); //std. deviation in offspring dispersal
-    const unsigned seed = atoi(argv[argn++]);  //RNG seed.
-    const unsigned format = atoi(argv[argn++]);
+    timing_params p;
+    p.N = atoi(argv[argn++]);
+    p.theta = atof(argv[argn++]);
+    p.rho = atof(argv[argn++]);
+    p.s = atof(argv[argn++]);       //selection coefficient
+    p.h = atof(argv[argn++]);       //dominance.  Fitnesses will be 1,1+sh,1+2s, so h=1=additive.
+    p.mu = atof(argv[argn++]);      //mutation rate to selected variants
+    p.radius = atof(argv[argn++]);  //Radius in which to search for mates.
+    p.dispersal = atof(argv[argn++]); //std. deviation in offspring dispersal
+    p.seed = atoi(argv[argn++]);  //RNG seed.
+    p.format = atoi(argv[argn++]);
+
+    landscape::options opts(argc,argv,argn);
+    p.mating = opts.get("mating","radius");
+    p.k = opts.get("k",8u);
+    p.max_distance = opts.get("max_distance",0.);
+    p.reorder = opts.get("reorder","none");
+    p.initial = opts.get("initial","quadrants");
+    p.numa = opts.get("numa","none");
+    p.huge_pages = opts.get("huge_pages","none");
+    const unsigned numa_parts = opts.get("numa_parts",unsigned(landscape::detail::numa_nodes().size()));
+    const std::string index = opts.get("index","quadratic64");
+    const std::string index_build = opts.get("index_build","insert");
+    const double cell_size = opts.get("cell_size",std::max(p.radius,1./std::sqrt(double(std::max(1u,p.N)))));
+    p.autotune = opts.get("autotune",0u);
+    p.sort_mates = opts.get("sort_mates",unsigned(p.reorder != "none" || p.autotune));
+    opts.check();
+    if(p.mating != "radius" && p.mating != "knn" && p.mating != "deme" && p.mating != "rejection")
+    {
+        std::cerr << "Error: mating must be radius, knn, deme or rejection\n";
+        exit(1);
+    }
+    if(p.reorder != "none" && p.reorder != "morton" && p.reorder != "hilbert")
+    {
+        std::cerr << "Error: reorder must be none, morton or hilbert\n";
+        exit(1);
+    }
+    if(!landscape::parse_index_config(index,index_build,cell_size,p.index))
+    {
+        std::cerr << "Error: index must be quadratic16, quadratic64, rstar16, linear16 or grid, "
+                  << "index_build insert or bulk, and cell_size > 0\n";
+        exit(1);
+    }
+    //Must be set before the population is allocated
+    if(!landscape::parse_placement(p.numa,p.huge_pages,landscape::memory_placement()))
+    {
+        std::cerr << "Error: numa must be none, interleave or partitioned, and huge_pages none, transparent or explicit\n";
+        exit(1);
+    }
+    landscape::memory_placement().nparts = numa_parts;
+#ifdef LANDSCAPE_BOUND_MODELS
+    simulate<landscape::runtime_mating>(p);
+#else
+    if(p.mating == "knn") simulate<landscape::fixed_mating<landscape::mating_mode::knn>>(p);
+    else if(p.mating == "deme") simulate<landscape::fixed_mating<landscape::mating_mode::deme>>(p);
+    else if(p.mating == "rejection") simulate<landscape::fixed_mating<landscape::mating_mode::rejection>>(p);
+    else simulate<landscape::fixed_mating<landscape::mating_mode::radius>>(p);
+#endif
+}
+
+template<typename mating_policy>
+void simulate(const timing_params & p)
+{
+    using rules_type = landscape::WFLandscapeRules<rtree_type,mating_policy>;
+    const unsigned N = p.N;
+    const double theta = p.theta, rho = p.rho, s = p.s, h = p.h, mu = p.mu;
+    const double radius = p.radius, dispersal = p.dispersal;
+    const unsigned seed = p.seed, format = p.format;
+    const std::string & mating = p.mating, & reorder = p.reorder, & initial = p.initial;
 
     //per-generation rates
     const double mu_n = theta/double(4*N);
@@ -110,35 +193,26 @@ int main(int argc, char ** argv)
     //takes care of that for us.
     KTfwd::GSLrng_t<KTfwd::GSL_RNG_MT19937> rng(seed);
 
-    //Our genetic map is uniform on the interval (0,1]
-    std::function<double(void)> recmap = std::bind(gsl_rng_uniform,rng.get());
-
-    //This is our population:
-    landscape::poptype pop(N);
+    //This is our population.  Its containers follow memory_placement():
+    landscape::placed_poptype pop(N);
 
-    //Assign random points in space to our diploids.
+    //Assign points in space to our diploids.
     //The geometry is a square (0,0) to (1,1).
-    //We assign 1/2 of diploids to upper left,
+    //By default, we assign 1/2 of diploids to upper left,
     //and 1/2 to lower right of the landscape initially.
-    rtree_type rtree;
-    for(std::size_t i=0; i<N; ++i)
+    //See initial.hpp for the other options.
+    //The rtree is then built from all the points in one pass.
+    std::vector<landscape::csdiploid::value> initial_values;
+    try
     {
-        double x=0.0,y=0.0;
-        if(i<N/2)
-        {
-            //Yes, I am aware that this does not truly
-            //sample uniformly in 2d...
-            x = gsl_ran_flat(rng.get(),0.,0.5);
-            y = gsl_ran_flat(rng.get(),0.5,1.);
-        }
-        else
-        {
-            x = gsl_ran_flat(rng.get(),0.5,1);
-            y = gsl_ran_flat(rng.get(),0.,0.5);
-        }
-        pop.diploids[i].v = landscape::csdiploid::value(std::make_pair(landscape::csdiploid::point(x,y),i));
-        rtree.insert(pop.diploids[i].v);
+        landscape::initial_landscape(initial,rng.get(),pop,initial_values,h);
+    }
+    catch(std::exception & e)
+    {
+        std::cerr << "Error: " << e.what() << '\n';
+        exit(1);
     }
+    rtree_type rtree(initial_values.begin(),initial_values.end(),p.index);
 
     //pre-allocate space for a good guess as to the total # mutations
     //expected at equilibrium.
@@ -149,6 +223,13 @@ int main(int argc, char ** argv)
      * the "mating radius" and the "dispersal radius"
      */
     rules_type rules(std::move(rtree),radius,dispersal);
+    if(mating == "knn") rules.mating = landscape::mating_mode::knn;
+    if(mating == "deme") rules.mating = landscape::mating_mode::deme;
+    if(mating == "rejection") rules.mating = landscape::mating_mode::rejection;
+    rules.k = p.k;
+    rules.max_distance = p.max_distance;
+    rules.sort_mates = p.sort_mates;
+    landscape::index_autotuner autotuner(p.autotune,rules.mating,radius,p.k);
 
     /* Now, we define our recombination,
      * fitness, and mutation models.
@@ -156,13 +237,18 @@ int main(int argc, char ** argv)
      * Recombination is uniform on the 1/2-open interval [0,1),
      * which is what the 0 and 1 are in the call below:
      */
+#ifdef LANDSCAPE_BOUND_MODELS
     auto recombination_model=std::bind(KTfwd::poisson_xover(),rng.get(),littler,0.,1.,
                                        std::placeholders::_1,std::placeholders::_2,std::placeholders::_3);
     /* Fitness is multiplicative, but with s treated as -s in a square
      * bounded by (0,0) to (0.5,0.5)
      */
-    auto fitness_model = std::bind(spatial_fitness(),std::placeholders::_1,std::placeholders::_2,
+    auto fitness_model = std::bind(landscape::spatial_fitness(),std::placeholders::_1,std::placeholders::_2,
                                    std::placeholders::_3);
+#else
+    landscape::poisson_recombination recombination_model(rng.get(),littler);
+    landscape::spatial_fitness fitness_model;
+#endif
     //We're going to initialized our generation here...
     unsigned generation=0;
 
@@ -180,6 +266,7 @@ int main(int argc, char ** argv)
      * but that is just beyond the scope here.
      */
 
+#ifdef LANDSCAPE_BOUND_MODELS
     //Mutation positions are uniform on (0,1]
     auto mutation_positions = [&rng] { return gsl_rng_uniform(rng.get()); };
     //Every mutation has the same selection coefficient...
@@ -197,6 +284,9 @@ int main(int argc, char ** argv)
                                     mutation_positions,
                                     selection_coefficients,
                                     dominance);
+#else
+    auto mutation_model = landscape::make_infsites_mutation(rng.get(),pop.mut_lookup,&generation,mu_n,mu,s,h);
+#endif
     /* This is the main workhorse.
      * We'll evolve for 10N generations.
      * Each generation, a call to fwdpp's experimental
@@ -210,6 +300,11 @@ int main(int argc, char ** argv)
      * removed, but that is optional--fwdpp has a few variants of that
      * function
      */
+    landscape::spatial_sorter<decltype(pop.diploids)> sorter(reorder == "hilbert" ? landscape::curve_type::hilbert
+            : landscape::curve_type::morton);
+    landscape::perf_counter cache_misses(landscape::perf_counter::event::cache_misses);
+    cache_misses.start();
+    auto start = std::chrono::steady_clock::now();
     for( ; generation < 10 ; ++generation )
     {
         double wbar = KTfwd::experimental::sample_diploid(rng.get(),
@@ -228,6 +323,43 @@ int main(int argc, char ** argv)
                       rules);
         //Take any fixed variants, transfer them out of population and into fixation time containers
         KTfwd::update_mutations(pop.mutations,pop.fixations,pop.fixation_times,pop.mut_lookup,pop.mcounts,generation,2*N);
+        if(reorder != "none") sorter(pop.diploids,rules);
+        autotuner(generation,pop.diploids,rules.offspring_rtree);
+    }
+    cache_misses.stop();
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    std::cerr << "mating = " << mating
+#ifdef LANDSCAPE_BOUND_MODELS
+              << ", models = bound"
+#else
+              << ", models = policies"
+#endif
+              << ", reorder = " << reorder << ", index = " << landscape::index_config_name(rules.offspring_rtree.settings())
+              << ", seconds = " << elapsed.count()
+              << ", cache misses = ";
+    if(cache_misses.available()) std::cerr << cache_misses.read();
+    else std::cerr << "NA";
+    std::cerr
+              << ", picks = " << rules.npicks << ", selfs = " << rules.nselfs
+              << ", forced selfs = " << rules.nforced_selfs
+              << ", selfing rate = " << double(rules.nselfs)/double(rules.npicks) << '\n';
+    if(rules.nrejection_tries || rules.nrejection_fallbacks)
+    {
+        std::cerr << "rejection tries per pick = " << double(rules.nrejection_tries)/double(rules.npicks)
+                  << ", fallbacks = " << rules.nrejection_fallbacks << '\n';
+    }
+    if(autotuner.active())
+    {
+        std::cerr << "autotune checks = " << autotuner.nchecks << ", switches = " << autotuner.nswitches
+                  << ", seconds = " << autotuner.seconds << ", neighbours per query = " << autotuner.neighbours << '\n';
+    }
+    if(landscape::memory_placement().active())
+    {
+        const auto & placed = landscape::placement_stats();
+        std::cerr << "numa = " << p.numa << ", huge_pages = " << p.huge_pages
+                  << ", placed bytes = " << placed.placed_bytes << ", hugetlb bytes = " << placed.hugetlb_bytes
+                  << ", mbind failures = " << placed.mbind_failures
+                  << ", madvise failures = " << placed.madvise_failures << '\n';
     }
     if(!format)
     {
@@ -236,33 +368,36 @@ int main(int argc, char ** argv)
         //the position + s for each mutation on each chromosome,
         //plus its coordinate.  Output will be "tidy",
         //e.g. ready for dplyr.
+        //Diploids are listed in birth order, which is
+        //not the order they are stored in if reorder is used.
         std::cout << "dip x y chrom pos s\n";
-        for(std::size_t i=0; i<pop.diploids.size(); ++i)
+        for(std::size_t b=0; b<pop.diploids.size(); ++b)
         {
+            const std::size_t i = rules.storage_index.empty() ? b : rules.storage_index[b];
             auto x = pop.diploids[i].v.first.get<0>();
             auto y = pop.diploids[i].v.first.get<1>();
             if(pop.gametes[pop.diploids[i].first].smutations.empty())
             {
-                std::cout << i << ' ' << x << ' ' << y << " 0 " <<"NA NA" << '\n';
+                std::cout << b << ' ' << x << ' ' << y << " 0 " <<"NA NA" << '\n';
             }
             else
             {
                 for(const auto & m : pop.gametes[pop.diploids[i].first].smutations)
                 {
-                    std::cout << i << ' ' << x << ' ' << y << " 0 "
+                    std::cout << b << ' ' << x << ' ' << y << " 0 "
                               << pop.mutations[m].pos << ' '
                               << pop.mutations[m].s << '\n';
                 }
             }
             if(pop.gametes[pop.diploids[i].second].smutations.empty())
             {
-                std::cout << i << ' ' << x << ' ' << y << " 1 " << "NA NA" << '\n';
+                std::cout << b << ' ' << x << ' ' << y << " 1 " << "NA NA" << '\n';
             }
             else
             {
                 for(const auto & m : pop.gametes[pop.diploids[i].second].smutations)
                 {
-                    std::cout << i << ' ' << x << ' ' << y << " 1 "
+                    std::cout << b << ' ' << x << ' ' << y << " 1 "
                               << pop.mutations[m].pos << ' '
                               << pop.mutations[m].s << '\n';
                 }
@@ -294,6 +429,11 @@ int main(int argc, char ** argv)
             unsigned i=0;
             std::generate(diploids2sample.begin(),diploids2sample.end(),[&i] {return i++;});
         }
+        //The above are birth orders.  Find where they are stored.
+        if(!rules.storage_index.empty())
+        {
+            for(auto & d : diploids2sample) d = unsigned(rules.storage_index[d]);
+        }
 
         auto popsample = KTfwd::sample_separate(pop,diploids2sample,true);//true = do not include variants fixed in the sample
         /*
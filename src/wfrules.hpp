@@ -2,9 +2,18 @@
 #define WFRULES_HPP
 #include <vector>
 #include <cmath>
+#include <cstdint>
+#include <cassert>
+#include <algorithm>
 #include <fwdpp/internal/gsl_discrete.hpp>
 #include <fwdpp/type_traits.hpp>
+#include <boost/geometry.hpp>
 #include <boost/geometry/index/rtree.hpp>
+#include "demes.hpp"
+#include "rejection.hpp"
+#include "policies.hpp"
+#include "placement.hpp"
+#include "indexquery.hpp"
 
 namespace landscape
 {
@@ -29,21 +38,74 @@ namespace landscape
  *    internally.
  * 4. call rules.update().
  *
- * The rules class is a template.  The template type
- * must be something with the API of a boost::geometry::rtree.
+ * The rules class is a template.  The first template type
+ * is the spatial index, which must be something with the API of a
+ * boost::geometry::rtree, or overload the queries in indexquery.hpp.
+ * The others are the mating and dispersal policies (see policies.hpp).
+ * The last is the dimension of the landscape, which is taken from the
+ * index's points.  This is the 2-d class: 1-d is specialized in
+ * linerules.hpp.
  */
-template<typename rtree_type>
+template<typename index_type>
+struct index_dimension
+{
+    static const std::size_t value = boost::geometry::dimension<typename index_type::value_type::first_type>::value;
+};
+
+template<typename rtree_type,
+         typename mating_policy = runtime_mating,
+         typename dispersal_policy = gaussian_dispersal,
+         std::size_t dim = index_dimension<rtree_type>::value>
 struct WFLandscapeRules
 {
+    static_assert(dim == 2, "the rules are for a 1-d or 2-d landscape");
     //These are data that our rules class
     //will have access to
     double wbar,radius,dispersal;
     std::size_t dipindex;
     std::vector<double> fitnesses,fitnesses_temp;
+    //Optional per-diploid multipliers of fitness, e.g. from
+    //local density regulation (see density.hpp).  If not empty,
+    //must be filled for the parents before each call to w.
+    std::vector<double> fitness_modifiers;
     //These are smart pointer wrappers around
     //gsl_ran_discrete_t
     KTfwd::fwdpp_internal::gsl_ran_discrete_t_ptr lookup,lookup2;
     rtree_type parental_rtree,offspring_rtree;
+    //Mate choice, if the mating policy is runtime_mating.
+    //For knn mating, k is the # of neighbours,
+    //and mates further away than max_distance are excluded if max_distance > 0.
+    mating_mode mating;
+    unsigned k;
+    double max_distance;
+    //Counters of calls to pick2, the # of times that parent 2 is parent 1,
+    //and the # of times that is because there was no one else to mate with.
+    std::uint64_t npicks,nselfs,nforced_selfs;
+    //For mating_mode::rejection: the most proposals per pick before
+    //falling back to pick2_radius, the # of proposals, and the # of fallbacks.
+    unsigned max_rejections;
+    std::uint64_t nrejection_tries,nrejection_fallbacks;
+    //Re-used each call to pick2
+    std::vector<typename rtree_type::value_type> possible_mates;
+    //If true, possible mates are sorted by birth order (see sort_possible_mates),
+    //and ties for k-th nearest are broken by birth order, so that the output
+    //does not depend on the index or on re-ordering.  That costs up to 40% of
+    //the run time for radius mating (see ordering_validation.cc), so it is off
+    //by default: the mates are then used in the order the index returns them.
+    //Re-ordering the diploids (see reorder.hpp) only leaves the output
+    //unchanged if this is true.
+    bool sort_mates;
+    //If the parents have been re-ordered in memory (see reorder.hpp),
+    //birth_order[i] is the order in which the diploid stored at i was born,
+    //and storage_index is the inverse.  Empty if diploids are in birth order.
+    //pick1 and pick2 work in terms of birth order, so that the output
+    //does not depend on where diploids are stored.
+    std::vector<std::size_t> birth_order,storage_index;
+    std::vector<double> fitnesses_birth_order;
+    //Used for mating_mode::deme
+    deme_grid demes;
+    //Used for mating_mode::rejection
+    rejection_grid rejection;
     //"Constructor" function initialized the object.
     //We need an initial rtree, the "mating radius",
     //and the dispersal radius.  The initial rtree
@@ -55,10 +117,59 @@ struct WFLandscapeRules
         lookup(KTfwd::fwdpp_internal::gsl_ran_discrete_t_ptr(nullptr)),
         lookup2(KTfwd::fwdpp_internal::gsl_ran_discrete_t_ptr(nullptr)),
         parental_rtree(rtree_type()),
-        offspring_rtree(std::move(r)) //we will move the initial rtree into the rtree for offspring
+        offspring_rtree(std::move(r)), //we will move the initial rtree into the rtree for offspring
+        mating(mating_mode::radius),k(0),max_distance(0.),
+        npicks(0),nselfs(0),nforced_selfs(0),
+        max_rejections(64),nrejection_tries(0),nrejection_fallbacks(0),
+        possible_mates(),sort_mates(false),
+        birth_order(),storage_index(),fitnesses_birth_order(),demes(),rejection()
+    {
+    }
+
+    //Copies are used to branch a simulation (see simulation.hpp).
+    //The lookup tables and grids are rebuilt by w() every generation,
+    //so they are not copied.
+    WFLandscapeRules(const WFLandscapeRules & other) :
+        wbar(other.wbar),radius(other.radius),dispersal(other.dispersal),dipindex(other.dipindex),
+        fitnesses(other.fitnesses),fitnesses_temp(),
+        fitness_modifiers(other.fitness_modifiers),
+        lookup(KTfwd::fwdpp_internal::gsl_ran_discrete_t_ptr(nullptr)),
+        lookup2(KTfwd::fwdpp_internal::gsl_ran_discrete_t_ptr(nullptr)),
+        parental_rtree(other.parental_rtree),offspring_rtree(other.offspring_rtree),
+        mating(other.mating),k(other.k),max_distance(other.max_distance),
+        npicks(other.npicks),nselfs(other.nselfs),nforced_selfs(other.nforced_selfs),
+        max_rejections(other.max_rejections),
+        nrejection_tries(other.nrejection_tries),nrejection_fallbacks(other.nrejection_fallbacks),
+        possible_mates(),sort_mates(other.sort_mates),
+        birth_order(other.birth_order),storage_index(other.storage_index),fitnesses_birth_order(),
+        demes(),rejection()
     {
     }
 
+    WFLandscapeRules(WFLandscapeRules &&) = default;
+    WFLandscapeRules & operator=(WFLandscapeRules &&) = default;
+
+    WFLandscapeRules & operator=(const WFLandscapeRules & other)
+    {
+        WFLandscapeRules temp(other);
+        return *this = std::move(temp);
+    }
+
+    //Start over from a new initial rtree, e.g. for another
+    //replicate, keeping the buffers allocated so far.
+    void reset(rtree_type && r)
+    {
+        wbar = 0.;
+        dipindex = 0;
+        parental_rtree.clear();
+        offspring_rtree = std::move(r);
+        npicks = nselfs = nforced_selfs = 0;
+        nrejection_tries = nrejection_fallbacks = 0;
+        fitness_modifiers.clear();
+        birth_order.clear();
+        storage_index.clear();
+    }
+
     //Get fitnesses for each diploid, tally current mean fitness.
     //Create fast lookup table for individuals based on fitness
     //Because this fxn is called first, it plays a role as a "setup"
@@ -74,8 +185,9 @@ struct WFLandscapeRules
     {
         //move the offspring rtree into the parental rtree
         parental_rtree = std::move(offspring_rtree);
-        //re-initialize offspring rtree
-        offspring_rtree=rtree_type();
+        //re-initialize offspring rtree, keeping any settings it has
+        //(see autotune.hpp)
+        offspring_rtree.clear();
         //set "dipindex to 0.
         dipindex=0;
         //Debug loop.  Will not be executed if compiled
@@ -85,14 +197,15 @@ struct WFLandscapeRules
         for(std::size_t i = 0 ; i < diploids.size() ; ++i)
         {
             std::vector<typename dipcont_t::value_type::value> v;
-            parental_rtree.query(boost::geometry::index::satisfies([&diploids,i](const typename dipcont_t::value_type::value & vi)
+            query_box(parental_rtree,diploids[i].v.first,diploids[i].v.first,
+                      [&diploids,i](const typename dipcont_t::value_type::value & vi)
             {
                 auto x = boost::geometry::get<0>(diploids[i].v.first);
                 auto y = boost::geometry::get<1>(diploids[i].v.first);
                 auto x2 = boost::geometry::get<0>(vi.first);
                 auto y2 = boost::geometry::get<1>(vi.first);
                 return x==x2&&y==y2;
-            }),
+            },
             std::back_inserter(v));
             assert(!v.empty());
             bool found=false;
@@ -106,24 +219,87 @@ struct WFLandscapeRules
         unsigned N_curr = diploids.size();
         //Rules classes are handy, as we can re-use
         //allocated RAM each generation:
+        //If memory_placement() says so, fitnesses are put on huge pages
+        //and/or spread over NUMA nodes (see placement.hpp).  That has to
+        //happen before the pages are first written, so the old values
+        //are not copied and the new ones are only filled in afterwards.
+        if(fitnesses.capacity() < N_curr)
+        {
+            fitnesses.clear();
+            fitnesses.reserve(N_curr);
+            place(fitnesses.data(),fitnesses.capacity()*sizeof(double));
+        }
         if(fitnesses.size() < N_curr) fitnesses.resize(N_curr);
+        wbar = 0.;
         for(std::size_t i = 0 ; i < diploids.size() ; ++i)
         {
             gametes[diploids[i].first].n=gametes[diploids[i].second].n=0; //set gamete counts to zero!!!!!
             fitnesses[i]=ff(diploids[i],gametes,mutations); //calc fitness of i-th diploid
+            if(!fitness_modifiers.empty()) fitnesses[i]*=fitness_modifiers[i];
             wbar+=fitnesses[i]; //keep track of mean fitness
         }
         wbar /= double(diploids.size());
 
         //this lookup table now allows picking a diploid in O(1) time!  Yay.
-        lookup = KTfwd::fwdpp_internal::gsl_ran_discrete_t_ptr(gsl_ran_discrete_preproc(N_curr,&fitnesses[0]));
+        if(birth_order.empty())
+        {
+            lookup = KTfwd::fwdpp_internal::gsl_ran_discrete_t_ptr(gsl_ran_discrete_preproc(N_curr,&fitnesses[0]));
+        }
+        else
+        {
+            //Build the table in birth order, so that the same random number
+            //picks the same parent no matter where it is stored.
+            assert(storage_index.size() == N_curr);
+            fitnesses_birth_order.resize(N_curr);
+            for(std::size_t i = 0 ; i < N_curr ; ++i) fitnesses_birth_order[i] = fitnesses[storage_index[i]];
+            lookup = KTfwd::fwdpp_internal::gsl_ran_discrete_t_ptr(gsl_ran_discrete_preproc(N_curr,&fitnesses_birth_order[0]));
+        }
+        if(mating_policy::uses_demes(*this))
+        {
+            demes.build(diploids,fitnesses,storage_index,radius);
+        }
+        if(mating_policy::uses_rejection(*this))
+        {
+            rejection.build(diploids,fitnesses,storage_index,radius);
+        }
     }
 
     //Pick parent 1 according to fitness
     //from the ENTIRE landscape
     inline size_t pick1(const gsl_rng * r) const
     {
-        return gsl_ran_discrete(r,lookup.get());
+        auto i = gsl_ran_discrete(r,lookup.get());
+        return storage_index.empty() ? i : storage_index[i];
+    }
+
+    //The birth order of the diploid stored at i
+    inline std::size_t birth_label(const std::size_t i) const
+    {
+        return birth_order.empty() ? i : birth_order[i];
+    }
+
+    //The order in which the rtree returns possible mates depends on
+    //how it was built.  Sorting by birth order makes the choice of mate
+    //independent of the rtree's parameters and of re-ordering.
+    inline void sort_possible_mates()
+    {
+        using value_t = typename rtree_type::value_type;
+        if(!sort_mates) return;
+        std::sort(possible_mates.begin(),possible_mates.end(),[this](const value_t & a, const value_t & b) {
+            return birth_label(a.second) < birth_label(b.second);
+        });
+    }
+
+    //Pick parent two near parent 1, according to the mating policy.
+    //Selfing is allowed in any mode.
+    template<typename diploid_t,typename gcont_t,typename mcont_t>
+    inline size_t pick2(const gsl_rng * r, const size_t & p1, const double & ,
+                        diploid_t & parent1, const gcont_t &, const mcont_t &)
+    {
+        ++npicks;
+        const std::size_t p2 = mating_policy::pick2(*this,r,p1,parent1);
+        if(p2==p1) ++nselfs;
+        return p2;
     }
 
     //Pick parent two in a radius centered on parent 1.
@@ -131,26 +307,121 @@ struct WFLandscapeRules
     //parent 1 is chosen as the second parent, and hence
     //selfing occurs.  Othersise, we choose parent 2
     //based on fitnesses within the radius.
-    template<typename diploid_t,typename gcont_t,typename mcont_t>
-    inline size_t pick2(const gsl_rng * r, const size_t & p1, const double & ,
-                        diploid_t & parent1, const gcont_t &, const mcont_t &)
+    template<typename diploid_t>
+    inline size_t pick2_radius(const gsl_rng * r, const size_t & p1, const diploid_t & parent1)
     {
         using value_t = typename diploid_t::value;
-        std::vector<value_t> possible_mates;
+        using point_t = typename diploid_t::point;
+        possible_mates.clear();
         //find all individuals in population whose Euclidiean distance
         //from parent1 is <= radius.  The "point" info fill up
         //the possible_mates vector.
-        parental_rtree.query(boost::geometry::index::satisfies([&parent1,this](const value_t & v) {
-            double p1x=boost::geometry::get<0>(parent1.v.first);
-            double p1y=boost::geometry::get<1>(parent1.v.first);
+        //The box lets the rtree skip nodes that are too far away, rather than
+        //testing every diploid.
+        double p1x=boost::geometry::get<0>(parent1.v.first);
+        double p1y=boost::geometry::get<1>(parent1.v.first);
+        query_box(parental_rtree,point_t(p1x-radius,p1y-radius),point_t(p1x+radius,p1y+radius),
+        [p1x,p1y,this](const value_t & v) {
             double p2x=boost::geometry::get<0>(v.first);
             double p2y=boost::geometry::get<1>(v.first);
             double euclid = std::sqrt(std::pow(p1x-p2x,2.0)+std::pow(p1y-p2y,2.0));
             return euclid <= radius;
-        }),
+        },
         std::back_inserter(possible_mates));
-        if(possible_mates.size()==1) return p1; //only possible mate was itself, so we self-fertilize
+        if(possible_mates.size()==1)
+        {
+            ++nforced_selfs;
+            return p1; //only possible mate was itself, so we self-fertilize
+        }
+        sort_possible_mates();
+        return choose_by_fitness(r);
+    }
+
+    //Pick parent two in a radius centered on parent 1, with the
+    //same distribution as pick2_radius, by rejection sampling (see rejection.hpp).
+    //If that gives up, pick2_radius is used, which also deals with
+    //parent 1 being alone in the radius.
+    template<typename diploid_t>
+    inline size_t pick2_rejection(const gsl_rng * r, const size_t & p1, const diploid_t & parent1)
+    {
+        const std::size_t p2 = rejection.pick(r,p1,boost::geometry::get<0>(parent1.v.first),
+                                              boost::geometry::get<1>(parent1.v.first),
+                                              max_rejections,nrejection_tries);
+        if(p2 != rejection_grid::failed) return p2;
+        ++nrejection_fallbacks;
+        return pick2_radius(r,p1,parent1);
+    }
 
+    //Pick parent two from parent 1 + its k nearest neighbours,
+    //optionally only those within max_distance.  The
+    //cost per pick is O(k log N), regardless of local density,
+    //and there are always k possible mates besides parent 1
+    //unless max_distance excludes them.
+    template<typename diploid_t>
+    inline size_t pick2_knn(const gsl_rng * r, const size_t & p1, const diploid_t & parent1)
+    {
+        using value_t = typename diploid_t::value;
+        using point_t = typename diploid_t::point;
+        namespace bg = boost::geometry;
+        const double p1x=bg::get<0>(parent1.v.first);
+        const double p1y=bg::get<1>(parent1.v.first);
+        auto distance = [p1x,p1y](const value_t & v) {
+            return std::sqrt(std::pow(p1x-bg::get<0>(v.first),2.0)+std::pow(p1y-bg::get<1>(v.first),2.0));
+        };
+        possible_mates.clear();
+        //parent 1 is its own nearest neighbour, hence k+1
+        if(!sort_mates)
+        {
+            //Take the mates in the order the index returns them
+            if(max_distance > 0.)
+            {
+                query_nearest(parental_rtree,parent1.v.first,k+1,max_distance,std::back_inserter(possible_mates));
+            }
+            else query_nearest(parental_rtree,parent1.v.first,k+1,std::back_inserter(possible_mates));
+            if(possible_mates.size()<=1)
+            {
+                ++nforced_selfs;
+                return p1;
+            }
+            return choose_by_fitness(r);
+        }
+        query_nearest(parental_rtree,parent1.v.first,k+1,std::back_inserter(possible_mates));
+        double dmax = 0.;
+        for(const auto & v : possible_mates) dmax = std::max(dmax,distance(v));
+        if(max_distance > 0.) dmax = std::min(dmax,max_distance);
+        if(possible_mates.size()==k+1 || max_distance > 0.)
+        {
+            //Diploids piled up at the edges of the landscape can be
+            //tied for k-th nearest, and which of them the rtree returns
+            //depends on how it was built.  So, get everyone within the
+            //k-th distance, and break ties by birth order.
+            possible_mates.clear();
+            query_box(parental_rtree,point_t(p1x-dmax,p1y-dmax),point_t(p1x+dmax,p1y+dmax),
+            [&distance,dmax](const value_t & v) {
+                return distance(v) <= dmax;
+            },
+            std::back_inserter(possible_mates));
+            if(possible_mates.size() > k+1)
+            {
+                std::sort(possible_mates.begin(),possible_mates.end(),[this,&distance](const value_t & a, const value_t & b) {
+                    double da = distance(a), db = distance(b);
+                    return da < db || (da == db && birth_label(a.second) < birth_label(b.second));
+                });
+                possible_mates.resize(k+1);
+            }
+        }
+        if(possible_mates.size()<=1)
+        {
+            ++nforced_selfs;
+            return p1;
+        }
+        sort_possible_mates();
+        return choose_by_fitness(r);
+    }
+
+    //Choose among possible_mates proportional to fitness
+    inline size_t choose_by_fitness(const gsl_rng * r)
+    {
         //build lookup table of possible mates.
         //selfing still allowed...
         if(fitnesses_temp.size() < possible_mates.size()) fitnesses_temp.resize(possible_mates.size());
@@ -199,21 +470,14 @@ struct WFLandscapeRules
                 const gcont_t &,
                 const mcont_t &)
     {
-        //Get coordinates for offspring, based on midpoint of parents +
-        //Gaussian dispersal independently along each axis.
-        //Another option for linear dispersal is
-        //https://www.gnu.org/software/gsl/manual/html_node/Spherical-Vector-Distributions.html
-        double x = (boost::geometry::get<0>(parent1.v.first)+boost::geometry::get<0>(parent2.v.first))/2.0 + gsl_ran_gaussian(r,dispersal);
-        if (x<0.)x=0.;
-        if (x>1.)x=1.;
-        double y = (boost::geometry::get<1>(parent1.v.first)+boost::geometry::get<1>(parent2.v.first))/2.0 + gsl_ran_gaussian(r,dispersal);
-        if (y<0.)y=0.;
-        if (y>1.)y=1.;
+        //Get coordinates for offspring from those of the parents.
+        //By default, the midpoint plus Gaussian dispersal (see policies.hpp).
         //"Label" the offspring with its coordinates.
         //b/c fwdpp guarantees filling diploids from 0 to N-1,
         //we use dipindex here to record where this offspring is
         //in the diploids container.
-        offspring.v = typename diploid_t::value(std::make_pair(typename diploid_t::point(x,y),dipindex++));
+        offspring.v = typename diploid_t::value(std::make_pair(dispersal_policy::place(r,parent1.v.first,parent2.v.first,dispersal),
+                                                               dipindex++));
         offspring_rtree.insert(offspring.v);
     }
 };
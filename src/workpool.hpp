@@ -0,0 +1,88 @@
+#ifndef LANDSCAPE_WORKPOOL_HPP
+#define LANDSCAPE_WORKPOOL_HPP
+
+#include <deque>
+#include <mutex>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <algorithm>
+
+namespace landscape
+{
+/*
+ * A work-stealing pool for a fixed set of tasks, numbered 0 to ntasks-1.
+ *
+ * Tasks are dealt round-robin onto one deque per thread.  Each thread
+ * takes tasks from the front of its own deque.  When that is empty, it
+ * steals from the back of the other threads' deques, so that a thread
+ * that drew short tasks helps out the ones that drew long tasks.
+ * Dealing tasks in order of decreasing cost keeps the tail short.
+ *
+ * f(worker, task) is called for each task, where worker is the
+ * index of the thread, so that f can keep per-thread state.
+ */
+class work_stealing_pool
+{
+    struct task_queue
+    {
+        std::mutex m;
+        std::deque<std::size_t> tasks;
+    };
+    std::vector<std::unique_ptr<task_queue>> queues;
+
+    bool pop(const std::size_t worker, std::size_t & task)
+    {
+        {
+            auto & q = *queues[worker];
+            std::lock_guard<std::mutex> lock(q.m);
+            if(!q.tasks.empty())
+            {
+                task = q.tasks.front();
+                q.tasks.pop_front();
+                return true;
+            }
+        }
+        for(std::size_t i = 1 ; i < queues.size() ; ++i)
+        {
+            auto & q = *queues[(worker+i)%queues.size()];
+            std::lock_guard<std::mutex> lock(q.m);
+            if(!q.tasks.empty())
+            {
+                task = q.tasks.back();
+                q.tasks.pop_back();
+                return true;
+            }
+        }
+        return false;
+    }
+public:
+    explicit work_stealing_pool(const unsigned nthreads) : queues()
+    {
+        for(unsigned i = 0 ; i < std::max(1u,nthreads) ; ++i) queues.emplace_back(new task_queue());
+    }
+
+    std::size_t size() const
+    {
+        return queues.size();
+    }
+
+    //Run tasks in the order given by order, which is a permutation of 0 to ntasks-1.
+    //Tasks never add tasks, so a thread is done when every deque is empty.
+    template<typename F>
+    void run(const std::vector<std::size_t> & order, F f)
+    {
+        for(std::size_t i = 0 ; i < order.size() ; ++i) queues[i%queues.size()]->tasks.push_back(order[i]);
+        std::vector<std::thread> threads;
+        for(std::size_t w = 0 ; w < queues.size() ; ++w)
+        {
+            threads.emplace_back([this,w,&f]() {
+                std::size_t task;
+                while(pop(w,task)) f(w,task);
+            });
+        }
+        for(auto & t : threads) t.join();
+    }
+};
+}
+#endif